@@ -64,6 +64,28 @@ void init_primitive_types()
     numberlike_t_ast.flags |= AST_FLAG_SYNTHETIC;
     boollike_t_ast.flags |= AST_FLAG_SYNTHETIC;
     
+    // Note: the built-in primitives are the canonical nodes of all primitive types
+    u8_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    u16_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    u32_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    u64_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    s8_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    s16_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    s32_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    s64_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    bool8_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    bool16_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    bool32_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    bool64_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    f32_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    f64_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    void_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    type_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    intlike_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    floatlike_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    numberlike_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    boollike_t_ast.flags |= TYPE_FLAG_CANONICAL;
+    
     u8_t_ast.s = next_serial++;
     u16_t_ast.s = next_serial++;
     u32_t_ast.s = next_serial++;
@@ -84,27 +106,28 @@ void init_primitive_types()
     floatlike_t_ast.s = next_serial++;
     numberlike_t_ast.s = next_serial++;
     boollike_t_ast.s = next_serial++;
+    first_compilation_serial = next_serial;
     
-    set_resolved_type(&u8_t_ast, &type_t_ast);
-    set_resolved_type(&u16_t_ast, &type_t_ast);
-    set_resolved_type(&u32_t_ast, &type_t_ast);
-    set_resolved_type(&u64_t_ast, &type_t_ast);
-    set_resolved_type(&s8_t_ast, &type_t_ast);
-    set_resolved_type(&s16_t_ast, &type_t_ast);
-    set_resolved_type(&s32_t_ast, &type_t_ast);
-    set_resolved_type(&s64_t_ast, &type_t_ast);
-    set_resolved_type(&bool8_t_ast, &type_t_ast);
-    set_resolved_type(&bool16_t_ast, &type_t_ast);
-    set_resolved_type(&bool32_t_ast, &type_t_ast);
-    set_resolved_type(&bool64_t_ast, &type_t_ast);
-    set_resolved_type(&f32_t_ast, &type_t_ast);
-    set_resolved_type(&f64_t_ast, &type_t_ast);
-    set_resolved_type(&void_t_ast, &type_t_ast);
-    set_resolved_type(&type_t_ast, &type_t_ast);
-    set_resolved_type(&intlike_t_ast, &type_t_ast);
-    set_resolved_type(&floatlike_t_ast, &type_t_ast);
-    set_resolved_type(&numberlike_t_ast, &type_t_ast);
-    set_resolved_type(&boollike_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &u8_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &u16_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &u32_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &u64_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &s8_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &s16_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &s32_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &s64_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &bool8_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &bool16_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &bool32_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &bool64_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &f32_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &f64_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &void_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &type_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &intlike_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &floatlike_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &numberlike_t_ast, &type_t_ast);
+    set_resolved_type(nullptr, &boollike_t_ast, &type_t_ast);
     
     u8_t_ast.primitive = PRIM_U8;
     u16_t_ast.primitive = PRIM_U16;
@@ -139,36 +162,36 @@ AST* construct_ast_(AST *new_ast, AST_Type type, u64 line_number, u64 line_offse
 }
 
 
-internal void print_dot_rec(Print_Buffer *pb, AST *ast);
-internal inline void print_dot_child(Print_Buffer *pb, AST *child, u64 parent_serial)
+internal void print_dot_rec(Print_Buffer *pb, Atom_Table *at, AST *ast);
+internal inline void print_dot_child(Print_Buffer *pb, Atom_Table *at, AST *child, u64 parent_serial)
 {
     u64 child_serial = child->s;
     print_buf(pb, "n%ld->n%ld;\n", parent_serial, child_serial);
-    print_dot_rec(pb, child);
+    print_dot_rec(pb, at, child);
 }
 
-internal void print_dot_rec(Print_Buffer *pb, AST *ast)
+internal void print_dot_rec(Print_Buffer *pb, Atom_Table *at, AST *ast)
 {
     u32 s = ast->s;
     switch(ast->type)
     {
         case AST_Type::ident_ast: {
             Ident_AST *ident_ast = static_cast<Ident_AST*>(ast);
-            String str = *ident_ast->atom.str;
+            String str = atom_string(at, ident_ast->atom);
             print_buf(pb, "n%ld[label=\"%.*s\"];\n", s, str.count, str.data);
         } break;
         case AST_Type::decl_ast: {
             Decl_AST *decl_ast = static_cast<Decl_AST*>(ast);
             
-            String str = *decl_ast->ident.atom.str;
+            String str = atom_string(at, decl_ast->ident.atom);
             print_buf(pb, "n%ld[label=\"Declare %.*s\"];\nn%ld[shape=box];\n", s, str.count, str.data, s);
             if(decl_ast->decl_type)
             {
-                print_dot_child(pb, decl_ast->decl_type, s);
+                print_dot_child(pb, at, decl_ast->decl_type, s);
             }
             if(decl_ast->expr)
             {
-                print_dot_child(pb, decl_ast->expr, s);
+                print_dot_child(pb, at, decl_ast->expr, s);
             }
         } break;
         case AST_Type::block_ast: {
@@ -178,7 +201,7 @@ internal void print_dot_rec(Print_Buffer *pb, AST *ast)
             
             for(u64 i = 0; i < block_ast->statements.count; ++i)
             {
-                print_dot_child(pb, block_ast->statements[i], s);
+                print_dot_child(pb, at, block_ast->statements[i], s);
             }
         } break;
         case AST_Type::function_type_ast: {
@@ -189,14 +212,14 @@ internal void print_dot_rec(Print_Buffer *pb, AST *ast)
             {
                 if(type_ast->parameter_types[i])
                 {
-                    print_dot_child(pb, type_ast->parameter_types[i], s);
+                    print_dot_child(pb, at, type_ast->parameter_types[i], s);
                 }
             }
             for(u64 i = 0; i < type_ast->return_types.count; ++i)
             {
                 if(type_ast->return_types[i])
                 {
-                    print_dot_child(pb, type_ast->return_types[i], s);
+                    print_dot_child(pb, at, type_ast->return_types[i], s);
                 }
             }
         } break;
@@ -205,44 +228,44 @@ internal void print_dot_rec(Print_Buffer *pb, AST *ast)
             
             print_buf(pb, "n%ld[label=\"Function\"];\nn%ld[shape=box];\n", s, s);
             
-            print_dot_child(pb, function_ast->prototype, s);
+            print_dot_child(pb, at, function_ast->prototype, s);
             for(u64 i = 0; i < function_ast->param_names.count; ++i)
             {
                 if(function_ast->param_names[i])
                 {
-                    print_dot_child(pb, function_ast->param_names[i], s);
+                    print_dot_child(pb, at, function_ast->param_names[i], s);
                 }
             }
             for(u64 i = 0; i < function_ast->default_values.count; ++i)
             {
                 if(function_ast->default_values[i])
                 {
-                    print_dot_child(pb, function_ast->default_values[i], s);
+                    print_dot_child(pb, at, function_ast->default_values[i], s);
                 }
             }
-            print_dot_child(pb, function_ast->block, s);
+            print_dot_child(pb, at, function_ast->block, s);
         } break;
         case AST_Type::function_call_ast: {
             Function_Call_AST *call_ast = static_cast<Function_Call_AST*>(ast);
             
             print_buf(pb, "n%ld[label=\"function call\"];\n", s);
-            print_dot_child(pb, call_ast->function, s);
+            print_dot_child(pb, at, call_ast->function, s);
             for(u64 i = 0; i < call_ast->args.count; ++i)
             {
-                print_dot_child(pb, call_ast->args[i], s);
+                print_dot_child(pb, at, call_ast->args[i], s);
             }
         } break;
         case AST_Type::access_ast: {
             Access_AST *access_ast = static_cast<Access_AST*>(ast);
             print_buf(pb, "n%ld[label=\".\"];\n", s);
-            print_dot_child(pb, access_ast->lhs, s);
+            print_dot_child(pb, at, access_ast->lhs, s);
         } break;
         case AST_Type::binary_operator_ast: {
             Binary_Operator_AST *bin_ast = static_cast<Binary_Operator_AST*>(ast);
             
             print_buf(pb, "n%ld[label=\"%s\"];\n", s, binary_operator_names[(u64)bin_ast->op]);
-            print_dot_child(pb, bin_ast->lhs, s);
-            print_dot_child(pb, bin_ast->rhs, s);
+            print_dot_child(pb, at, bin_ast->lhs, s);
+            print_dot_child(pb, at, bin_ast->rhs, s);
         } break;
         case AST_Type::number_ast: {
             Number_AST *number_ast = static_cast<Number_AST*>(ast);
@@ -252,8 +275,8 @@ internal void print_dot_rec(Print_Buffer *pb, AST *ast)
             While_AST *while_ast = static_cast<While_AST*>(ast);
             
             print_buf(pb, "n%ld[label=\"while\"];\n", s);
-            print_dot_child(pb, while_ast->guard, s);
-            print_dot_child(pb, while_ast->body, s);
+            print_dot_child(pb, at, while_ast->guard, s);
+            print_dot_child(pb, at, while_ast->body, s);
         } break;
         case AST_Type::for_ast: {
             For_AST *for_ast = static_cast<For_AST*>(ast);
@@ -278,33 +301,33 @@ internal void print_dot_rec(Print_Buffer *pb, AST *ast)
             
             if(for_ast->induction_var)
             {
-                print_dot_child(pb, for_ast->induction_var, s);
+                print_dot_child(pb, at, for_ast->induction_var, s);
             }
             if(for_ast->flags & FOR_FLAG_OVER_ARRAY)
             {
                 if(for_ast->index_var)
                 {
-                    print_dot_child(pb, for_ast->index_var, s);
+                    print_dot_child(pb, at, for_ast->index_var, s);
                 }
-                print_dot_child(pb, for_ast->array_expr, s);
+                print_dot_child(pb, at, for_ast->array_expr, s);
             }
             else
             {
-                print_dot_child(pb, for_ast->low_expr, s);
-                print_dot_child(pb, for_ast->high_expr, s);
+                print_dot_child(pb, at, for_ast->low_expr, s);
+                print_dot_child(pb, at, for_ast->high_expr, s);
             }
             
-            print_dot_child(pb, for_ast->body, s);
+            print_dot_child(pb, at, for_ast->body, s);
         } break;
         case AST_Type::if_ast: {
             If_AST *if_ast = static_cast<If_AST*>(ast);
             
             print_buf(pb, "n%ld[label=\"if\"];\n", s);
-            print_dot_child(pb, if_ast->guard, s);
-            print_dot_child(pb, if_ast->then_block, s);
+            print_dot_child(pb, at, if_ast->guard, s);
+            print_dot_child(pb, at, if_ast->then_block, s);
             if(if_ast->else_block)
             {
-                print_dot_child(pb, if_ast->else_block, s);
+                print_dot_child(pb, at, if_ast->else_block, s);
             }
         } break;
         case AST_Type::struct_ast: {
@@ -313,40 +336,44 @@ internal void print_dot_rec(Print_Buffer *pb, AST *ast)
             print_buf(pb, "n%ld[label=\"struct\"];\n", s);
             for(u64 i = 0; i < struct_ast->constants.count; ++i)
             {
-                print_dot_child(pb, struct_ast->constants[i], s);
+                print_dot_child(pb, at, struct_ast->constants[i], s);
             }
             for(u64 i = 0; i < struct_ast->fields.count; ++i)
             {
-                print_dot_child(pb, struct_ast->fields[i], s);
+                print_dot_child(pb, at, struct_ast->fields[i], s);
             }
         } break;
         case AST_Type::enum_ast: {
             Enum_AST *enum_ast = static_cast<Enum_AST*>(ast);
             
             print_buf(pb, "n%ld[label=\"enum\"];\n", s);
+            if(enum_ast->underlying_type)
+            {
+                print_dot_child(pb, at, enum_ast->underlying_type, s);
+            }
             for(u64 i = 0; i < enum_ast->values.count; ++i)
             {
-                print_dot_child(pb, enum_ast->values[i], s);
+                print_dot_child(pb, at, enum_ast->values[i], s);
             }
         } break;
         case AST_Type::assign_ast: {
             Assign_AST *assign_ast = static_cast<Assign_AST*>(ast);
             
             print_buf(pb, "n%ld[label=\"%s\"];\n", s, assign_names[(u64)assign_ast->assign_type]);
-            print_dot_child(pb, assign_ast->lhs, s);
-            print_dot_child(pb, assign_ast->rhs, s);
+            print_dot_child(pb, at, assign_ast->lhs, s);
+            print_dot_child(pb, at, assign_ast->rhs, s);
         } break;
         case AST_Type::unary_ast: {
             Unary_Operator_AST *unary_ast = static_cast<Unary_Operator_AST*>(ast);
             
             print_buf(pb, "n%ld[label=\"%s\"];\n", s, unary_operator_names[(u64)unary_ast->op]);
-            print_dot_child(pb, unary_ast->operand, s);
+            print_dot_child(pb, at, unary_ast->operand, s);
         } break;
         case AST_Type::return_ast: {
             Return_AST *return_ast = static_cast<Return_AST*>(ast);
             
             print_buf(pb, "n%ld[label=\"return\"];\n", s);
-            print_dot_child(pb, return_ast->expr, s);
+            print_dot_child(pb, at, return_ast->expr, s);
         } break;
         case AST_Type::primitive_ast: {
             Primitive_AST *primitive_ast = static_cast<Primitive_AST*>(ast);
@@ -372,13 +399,13 @@ internal void print_dot_rec(Print_Buffer *pb, AST *ast)
     }
 }
 
-void print_dot(Print_Buffer *pb, Array<Decl_AST*> decls)
+void print_dot(Print_Buffer *pb, Atom_Table *at, Array<Decl_AST*> decls)
 {
     print_buf(pb, "digraph decls {\n");
     
     for(u64 i = 0; i < decls.count; ++i)
     {
-        print_dot_rec(pb, decls[i]);
+        print_dot_rec(pb, at, decls[i]);
     }
     
     print_buf(pb, "}\n");
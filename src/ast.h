@@ -70,7 +70,10 @@ constexpr u16 EXPR_FLAG_NOT_LVALUE = 0x20;
 constexpr u16 EXPR_FLAG_LVALUE_MASK = 0x30;
 constexpr u16 NUMBER_FLAG_FLOATLIKE = 0x40;
 constexpr u16 TYPE_FLAG_EVALUATED = 0x40;
-constexpr u16 TYPE_FLAG_CANONICAL = 0x80; // TODO: is this needed?
+// Note: the node is the one a Type_Table maps all equal types to
+constexpr u16 TYPE_FLAG_CANONICAL = 0x80;
+// Note: some typecheck job is parked until this is resolved
+constexpr u16 EXPR_FLAG_HAS_WAITERS = 0x100;
 
 
 
@@ -84,6 +87,8 @@ struct AST
 };
 
 u32 next_serial = 0;
+// Note: the serials before this are the built-in types, later ones are numbered per compilation
+u32 first_compilation_serial = 0;
 
 struct Expr_AST : AST
 {
@@ -252,14 +257,15 @@ struct Ident_AST : Expr_AST
 {
     static constexpr AST_Type type_value = AST_Type::ident_ast;
     
+    // Note: ident is replaced by the rest when the scopes are created
     union {
         String ident;
         struct {
             Atom atom;
+            u32 scope_index;
             u64 tagged_expr_ptr;
         };
     };
-    u64 scope_index;
     Hashed_Scope *scope;
 };
 
@@ -268,16 +274,18 @@ u64 ident_get_type(Ident_AST *ident)
 {
     return ident->tagged_expr_ptr & IDENT_TYPE_MASK;
 }
+// Note: the typechecker may set the expr on one thread while another reads it, so the pointer
+// is published with a single release store
 inline
 Expr_AST *ident_get_expr(Ident_AST *ident)
 {
-    return (Expr_AST*)(ident->tagged_expr_ptr & ~IDENT_TYPE_MASK);
+    return (Expr_AST*)(__atomic_load_n(&ident->tagged_expr_ptr, __ATOMIC_ACQUIRE) & ~IDENT_TYPE_MASK);
 }
 inline
 void ident_set_expr(Ident_AST *ident, Expr_AST *expr)
 {
-    ident->tagged_expr_ptr &= IDENT_TYPE_MASK;
-    ident->tagged_expr_ptr |= (u64)expr;
+    u64 tagged = (ident->tagged_expr_ptr & IDENT_TYPE_MASK) | (u64)expr;
+    __atomic_store_n(&ident->tagged_expr_ptr, tagged, __ATOMIC_RELEASE);
 }
 
 
@@ -358,11 +366,17 @@ struct Access_AST : Expr_AST
         String ident;
         struct {
             Atom atom;
+            // Note: the position in Struct_AST::fields, or ACCESS_NOT_FIELD
+            u32 field_index;
             Expr_AST *expr;
         };
     };
+    // Note: in bytes from the start of the struct, only set for fields
+    u64 field_offset;
 };
 
+constexpr u32 ACCESS_NOT_FIELD = (u32)-1;
+
 enum class Binary_Operator : u64
 {
     cmp_eq,
@@ -443,6 +457,16 @@ struct If_AST : AST
     Block_AST *else_block;
 };
 
+// Note: computed when the struct is typechecked, alignment is 0 until then
+struct Struct_Layout
+{
+    u64 size;
+    u64 alignment;
+    // Note: indexed like Struct_AST::fields
+    u64 *field_offsets;
+    u64 *field_sizes;
+};
+
 struct Struct_AST : Expr_AST
 {
     static constexpr AST_Type type_value = AST_Type::struct_ast;
@@ -451,6 +475,22 @@ struct Struct_AST : Expr_AST
     Array<Decl_AST*> fields;
     Hashed_Scope *constant_scope;
     Hashed_Scope *field_scope;
+    // Note: the constants are members 0 to constants.count, followed by the fields
+    // A field with the same name as a constant is not in it, since the constant hides it
+    Member_Index member_index;
+    Struct_Layout layout;
+};
+
+// Note: computed when the enum is typechecked, values is nullptr until then
+struct Enum_Table
+{
+    // Note: indexed by ordinal
+    s64 *values;
+    s64 min_value;
+    s64 max_value;
+    // Note: set if every value from min_value to max_value is used exactly once, so a value
+    // can index an array of max_value - min_value + 1 entries
+    bool contiguous;
 };
 
 struct Enum_AST : Expr_AST
@@ -459,6 +499,11 @@ struct Enum_AST : Expr_AST
     
     Array<Decl_AST*> values;
     Hashed_Scope *scope;
+    // Note: the integer type the values are stored as, s64 if this is nullptr
+    Expr_AST *underlying_type;
+    // Note: maps the name of each value to its ordinal, its position in values
+    Member_Index member_index;
+    Enum_Table table;
 };
 
 enum class Assign_Operator : u64
@@ -523,7 +568,8 @@ struct Return_AST : AST
 };
 
 void init_primitive_types();
-void print_dot(Print_Buffer *pb, Array<Decl_AST*> decls);
+// Note: after create_scope_metadata, the names are in the atom table
+void print_dot(Print_Buffer *pb, Atom_Table *at, Array<Decl_AST*> decls);
 
 AST* construct_ast_(AST *new_ast, AST_Type type, u64 line_number, u64 line_offset);
 
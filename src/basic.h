@@ -112,6 +112,12 @@ void *mem_resize_(void *old_ptr, u64 old_n, u64 new_n, Allocator a);
 inline
 void mem_dealloc_(void *old_ptr, u64 old_n, Allocator a);
 
+// Note: x86 time stamp counter, in cycles
+inline
+u64 read_tsc();
+
+template<typename T>
+T min(T t1, T t2);
 template<typename T>
 T max(T t1, T t2);
 
@@ -134,12 +140,45 @@ struct Dynamic_Array
     T &operator[](u64 idx);
 };
 
+// Note: Keeps the first N elements inline, and only uses the allocator once it outgrows them
+// data is nullptr while the elements are inline, so a zeroed Small_Array is empty
+// Must be freed with array_free once it may have spilled to the allocator
+template <typename T, u64 N>
+struct Small_Array
+{
+    u64 count;
+    u64 allocated;
+    T *data;
+    T inline_data[N];
+    
+    T &operator[](u64 idx);
+};
+
+// Note: Dynamic_Array growth policy, the new capacity is capacity * NUM / DEN
+// e.g. -DARRAY_GROWTH_NUM=3 -DARRAY_GROWTH_DEN=2 for 1.5x
+#ifndef ARRAY_GROWTH_NUM
+#define ARRAY_GROWTH_NUM 2
+#endif
+#ifndef ARRAY_GROWTH_DEN
+#define ARRAY_GROWTH_DEN 1
+#endif
+#ifndef ARRAY_MIN_CAPACITY
+#define ARRAY_MIN_CAPACITY 4
+#endif
+
+inline
+u64 array_grow_size(u64 allocated);
+
 template<typename T>
 bool operator==(Array<T> a1, Array<T> a2);
 
 template<typename T>
 Array<T> make_array(u64 count, T *data);
 
+// Note: does not copy, the String points into str
+inline
+String c_string(const byte *str);
+
 template<typename T>
 void array_add(Dynamic_Array<T> *arr, T element, Allocator a = default_allocator);
 template<typename T>
@@ -147,8 +186,17 @@ void array_resize(Dynamic_Array<T> *arr, u64 new_size, Allocator a = default_all
 template<typename T>
 void array_trim(Dynamic_Array<T> *arr, Allocator a = default_allocator);
 template<typename T>
+void array_free(Dynamic_Array<T> *arr, Allocator a = default_allocator);
+template<typename T>
 Array<T> array_copy(Array<T> arr, Allocator a = default_allocator);
 
+template<typename T, u64 N>
+void array_add(Small_Array<T,N> *arr, T element, Allocator a = default_allocator);
+template<typename T, u64 N>
+void array_free(Small_Array<T,N> *arr, Allocator a = default_allocator);
+template<typename T, u64 N>
+Array<T> get_array(Small_Array<T,N> *arr);
+
 //
 // Common Macros
 //
@@ -191,6 +239,26 @@ CONCAT(str, __LINE__)
 #include <stdlib.h>
 #include <string.h>
 
+inline
+u64 read_tsc()
+{
+    register u64 rax asm("rax");
+    register u64 rdx asm("rdx");
+    asm volatile ("rdtsc"
+                  : "=r" (rax), "=r" (rdx));
+    rax |= rdx << 32;
+    return rax;
+}
+
+inline
+String c_string(const byte *str)
+{
+    String result;
+    result.count = strlen(str);
+    result.data = (byte*)str;
+    return result;
+}
+
 inline
 void zero_memory_(void *ptr, u64 size)
 {
@@ -235,6 +303,27 @@ T &Dynamic_Array<T>::operator[](u64 idx)
     return this->data[idx];
 }
 
+template<typename T, u64 N>
+T &Small_Array<T,N>::operator[](u64 idx)
+{
+    return this->data ? this->data[idx] : this->inline_data[idx];
+}
+
+inline
+u64 array_grow_size(u64 allocated)
+{
+    u64 new_size = allocated * ARRAY_GROWTH_NUM / ARRAY_GROWTH_DEN;
+    if(new_size <= allocated)
+    {
+        new_size = allocated + 1;
+    }
+    if(new_size < ARRAY_MIN_CAPACITY)
+    {
+        new_size = ARRAY_MIN_CAPACITY;
+    }
+    return new_size;
+}
+
 template<typename T>
 bool operator==(Array<T> a1, Array<T> a2)
 {
@@ -266,12 +355,7 @@ void array_add(Dynamic_Array<T> *arr, T element, Allocator a)
 {
     if(arr->count == arr->allocated)
     {
-        u64 new_size = 4 * arr->allocated;
-        if(new_size == 0)
-        {
-            new_size = 4;
-        }
-        array_resize(arr, new_size, a);
+        array_resize(arr, array_grow_size(arr->allocated), a);
     }
     
     (*arr)[arr->count] = element;
@@ -302,7 +386,7 @@ void array_resize(Dynamic_Array<T> *arr, u64 new_size, Allocator a)
             }
         }
     }
-    else
+    else if(new_size > 0)
     {
         assert(arr->count == 0);
         
@@ -318,6 +402,12 @@ void array_trim(Dynamic_Array<T> *arr, Allocator a)
     array_resize(arr, arr->count, a);
 }
 
+template<typename T>
+void array_free(Dynamic_Array<T> *arr, Allocator a)
+{
+    array_resize(arr, 0, a);
+}
+
 template<typename T>
 Array<T> array_copy(Array<T> arr, Allocator a)
 {
@@ -329,6 +419,60 @@ Array<T> array_copy(Array<T> arr, Allocator a)
     return result;
 }
 
+template<typename T, u64 N>
+void array_add(Small_Array<T,N> *arr, T element, Allocator a)
+{
+    if(!arr->data)
+    {
+        if(arr->count < N)
+        {
+            arr->inline_data[arr->count] = element;
+            ++arr->count;
+            return;
+        }
+        
+        u64 new_size = array_grow_size(N);
+        arr->data = mem_alloc(T, new_size, a);
+        assert(arr->data);
+        arr->allocated = new_size;
+        copy_memory(arr->data, arr->inline_data, arr->count);
+    }
+    else if(arr->count == arr->allocated)
+    {
+        u64 new_size = array_grow_size(arr->allocated);
+        arr->data = mem_resize(arr->data, arr->allocated, new_size, a);
+        assert(arr->data);
+        arr->allocated = new_size;
+    }
+    
+    arr->data[arr->count] = element;
+    ++arr->count;
+}
+
+template<typename T, u64 N>
+void array_free(Small_Array<T,N> *arr, Allocator a)
+{
+    if(arr->data)
+    {
+        mem_dealloc(arr->data, arr->allocated, a);
+    }
+    arr->count = 0;
+    arr->allocated = 0;
+    arr->data = nullptr;
+}
+
+template<typename T, u64 N>
+Array<T> get_array(Small_Array<T,N> *arr)
+{
+    return make_array(arr->count, arr->data ? arr->data : arr->inline_data);
+}
+
+template<typename T>
+T min(T t1, T t2)
+{
+    return t1 < t2 ? t1 : t2;
+}
+
 template<typename T>
 T max(T t1, T t2)
 {
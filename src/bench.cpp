@@ -0,0 +1,841 @@
+
+// Note: the source text is kept, the identifiers point into it
+struct Bench_Identifiers
+{
+    String file_contents;
+    Dynamic_Array<String> identifiers;
+};
+
+internal
+bool load_identifiers(Bench_Identifiers *bi, const byte *file_name)
+{
+    zero_struct(bi);
+    bi->file_contents = read_entire_file(file_name);
+    if(!bi->file_contents.data)
+    {
+        print_err("Unable to read %s\n", file_name);
+        return false;
+    }
+    
+    Dynamic_Array<Token> tokens = lex_string(bi->file_contents);
+    if(!tokens.data)
+    {
+        mem_dealloc(bi->file_contents.data, bi->file_contents.count);
+        return false;
+    }
+    
+    for(u64 i = 0; i < tokens.count; ++i)
+    {
+        if(tokens[i].type == Token_Type::ident)
+        {
+            array_add(&bi->identifiers, tokens[i].contents);
+        }
+    }
+    array_free(&tokens);
+    
+    if(bi->identifiers.count == 0)
+    {
+        print_err("No identifiers in %s\n", file_name);
+        mem_dealloc(bi->file_contents.data, bi->file_contents.count);
+        return false;
+    }
+    return true;
+}
+
+internal
+void free_identifiers(Bench_Identifiers *bi)
+{
+    array_free(&bi->identifiers);
+    mem_dealloc(bi->file_contents.data, bi->file_contents.count);
+}
+
+// Note: enough rounds that each measurement covers a few million operations
+internal
+u64 bench_rounds(u64 ops_per_round)
+{
+    u64 rounds = 4000000 / ops_per_round;
+    return rounds > 0 ? rounds : 1;
+}
+
+template<u64 (*H)(String)>
+internal
+void bench_hash(const byte *name, Array<String> identifiers)
+{
+    u64 rounds = bench_rounds(identifiers.count);
+    u64 checksum = 0;
+    
+    u64 start = read_clock_ns();
+    for(u64 r = 0; r < rounds; ++r)
+    {
+        for(u64 i = 0; i < identifiers.count; ++i)
+        {
+            checksum += H(identifiers[i]);
+        }
+    }
+    u64 elapsed = read_clock_ns() - start;
+    
+    u64 ops = rounds * identifiers.count;
+    print("  %-12s hash:   %6.2f ns/op (checksum %llx)\n", name, (double)elapsed / ops, checksum);
+}
+
+// Note: the atom table, without copying the strings, to compare hash functions
+template<u64 (*H)(String)>
+internal
+void bench_set_lookup(const byte *name, Array<String> identifiers)
+{
+    u64 rounds = bench_rounds(identifiers.count);
+    
+    Hash_Set<Atom_Entry,String,get_str,H,operator==> set;
+    init_hash_set(&set, 128);
+    defer {
+        free_hash_set(&set);
+    };
+    
+    u64 start = read_clock_ns();
+    for(u64 r = 0; r < rounds; ++r)
+    {
+        clear_hash_set(&set);
+        for(u64 i = 0; i < identifiers.count; ++i)
+        {
+            String str = identifiers[i];
+            u64 hash = H(str);
+            u64 slot = set_find_slot(&set, str, hash);
+            if(set_slot_empty(&set, slot))
+            {
+                Atom_Entry entry = {str, {(u32)set.count}};
+                set_insert_into_slot(&set, slot, hash, entry);
+            }
+        }
+    }
+    u64 elapsed = read_clock_ns() - start;
+    
+    u64 ops = rounds * identifiers.count;
+    print("  %-12s lookup: %6.2f ns/op (%lu unique)\n", name, (double)elapsed / ops, set.count);
+}
+
+internal
+bool bench_atomize(const byte *file_name)
+{
+    Bench_Identifiers bi;
+    if(!load_identifiers(&bi, file_name))
+    {
+        return false;
+    }
+    defer {
+        free_identifiers(&bi);
+    };
+    Array<String> identifiers = bi.identifiers.array;
+    
+    u64 total_length = 0;
+    u64 short_count = 0;
+    for(u64 i = 0; i < identifiers.count; ++i)
+    {
+        total_length += identifiers[i].count;
+        short_count += (identifiers[i].count <= 16);
+    }
+    print("%lu identifiers, average length %.1f, %.1f%% up to 16 bytes\n", identifiers.count, (double)total_length / identifiers.count, 100.0 * short_count / identifiers.count);
+    
+    bench_hash<fnv1a_64>("fnv1a_64", identifiers);
+    bench_hash<hash_string>("hash_string", identifiers);
+    bench_set_lookup<fnv1a_64>("fnv1a_64", identifiers);
+    bench_set_lookup<hash_string>("hash_string", identifiers);
+    
+    Atom_Table atom_table;
+    init_atom_table(&atom_table, 128, 4096);
+    defer {
+        free_atom_table(&atom_table);
+    };
+    
+    u64 rounds = bench_rounds(identifiers.count);
+    u64 start = read_clock_ns();
+    for(u64 r = 0; r < rounds; ++r)
+    {
+        reset_atom_table(&atom_table);
+        for(u64 i = 0; i < identifiers.count; ++i)
+        {
+            atomize_string(&atom_table, identifiers[i]);
+        }
+    }
+    u64 elapsed = read_clock_ns() - start;
+    
+    u64 ops = rounds * identifiers.count;
+    print("  atomize_string:      %6.2f ns/op (%.1f M/s)\n", (double)elapsed / ops, 1000.0 * ops / elapsed);
+    return true;
+}
+
+struct Atomize_Thread
+{
+    pthread_t thread;
+    Concurrent_Atom_Table *atom_table;
+    Pool_Allocator string_pool;
+    Array<String> identifiers;
+    u64 start_index;
+    u64 rounds;
+    // Note: the atom of each identifier, as seen by this thread
+    Atom *atoms;
+};
+
+internal
+void *atomize_thread(void *data)
+{
+    Atomize_Thread *t = static_cast<Atomize_Thread*>(data);
+    for(u64 r = 0; r < t->rounds; ++r)
+    {
+        // Note: every thread interns all identifiers, starting at a different point
+        u64 i = t->start_index;
+        for(u64 j = 0; j < t->identifiers.count; ++j)
+        {
+            t->atoms[i] = atomize_string(t->atom_table, &t->string_pool, t->identifiers[i]);
+            ++i;
+            if(i == t->identifiers.count)
+            {
+                i = 0;
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Note: rounds interning into a fresh table, with 1 to 32 threads sharing the table
+internal
+bool bench_atomize_threads(const byte *file_name)
+{
+    Bench_Identifiers bi;
+    if(!load_identifiers(&bi, file_name))
+    {
+        return false;
+    }
+    defer {
+        free_identifiers(&bi);
+    };
+    Array<String> identifiers = bi.identifiers.array;
+    
+    u64 total_length = 0;
+    for(u64 i = 0; i < identifiers.count; ++i)
+    {
+        total_length += identifiers[i].count;
+    }
+    
+    // Note: the single-threaded table with the same work as one thread, for reference
+    u64 unique_count = 0;
+    {
+        Atom_Table atom_table;
+        init_atom_table(&atom_table, 128, 4096);
+        
+        u64 rounds = bench_rounds(identifiers.count);
+        u64 start = read_clock_ns();
+        for(u64 r = 0; r < rounds; ++r)
+        {
+            for(u64 i = 0; i < identifiers.count; ++i)
+            {
+                atomize_string(&atom_table, identifiers[i]);
+            }
+        }
+        u64 elapsed = read_clock_ns() - start;
+        
+        unique_count = atom_table.strings.count;
+        free_atom_table(&atom_table);
+        
+        u64 ops = rounds * identifiers.count;
+        print("%lu identifiers, %lu unique\n", identifiers.count, unique_count);
+        print("  Atom_Table: %6.2f ns/op\n", (double)elapsed / ops);
+    }
+    
+    const u64 max_threads = 32;
+    Atomize_Thread threads[max_threads];
+    
+    for(u64 thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+    {
+        Concurrent_Atom_Table *atom_table = mem_alloc(Concurrent_Atom_Table);
+        assert(atom_table);
+        init_concurrent_atom_table(atom_table);
+        
+        u64 rounds = bench_rounds(identifiers.count * thread_count);
+        for(u64 i = 0; i < thread_count; ++i)
+        {
+            Atomize_Thread *t = &threads[i];
+            t->atom_table = atom_table;
+            t->identifiers = identifiers;
+            t->start_index = i * identifiers.count / thread_count;
+            t->rounds = rounds;
+            t->atoms = mem_alloc(Atom, identifiers.count);
+            assert(t->atoms);
+            
+            // Note: one block that fits every string, allocated up front, so that the pools
+            // don't allocate blocks (and print) from the threads
+            pool_init(&t->string_pool, total_length + 4096);
+            pool_alloc(byte, 1, &t->string_pool);
+        }
+        
+        u64 start = read_clock_ns();
+        for(u64 i = 0; i < thread_count; ++i)
+        {
+            pthread_create(&threads[i].thread, nullptr, atomize_thread, &threads[i]);
+        }
+        for(u64 i = 0; i < thread_count; ++i)
+        {
+            pthread_join(threads[i].thread, nullptr);
+        }
+        u64 elapsed = read_clock_ns() - start;
+        
+        // Note: every thread must have gotten the same atom for the same string
+        bool consistent = (atom_count(atom_table) == unique_count);
+        for(u64 i = 0; i < identifiers.count; ++i)
+        {
+            Atom atom = threads[0].atoms[i];
+            for(u64 j = 1; j < thread_count; ++j)
+            {
+                consistent = consistent && (threads[j].atoms[i] == atom);
+            }
+            consistent = consistent && (atom_string(atom_table, atom) == identifiers[i]);
+        }
+        
+        u64 ops = rounds * identifiers.count * thread_count;
+        print("  %2lu threads: %6.2f ns/op, %6.1f M/s total%s\n", thread_count, (double)elapsed / ops, 1000.0 * ops / elapsed, consistent ? "" : " INCONSISTENT ATOMS");
+        
+        for(u64 i = 0; i < thread_count; ++i)
+        {
+            pool_release(&threads[i].string_pool);
+            mem_dealloc(threads[i].atoms, identifiers.count);
+        }
+        free_concurrent_atom_table(atom_table);
+        mem_dealloc(atom_table);
+        
+        if(!consistent)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Note: the stress benchmarks below make their own input, and ignore the file
+
+// Note: a Hash_Set only looks at the low 7 bits (the tag) and the next log2(groups) bits of a
+// hash, so identifiers that agree in the low FLOOD_HASH_BITS bits of fnv1a_64 all go to the same
+// group with the same tag, in any set of up to 2^13 groups
+constexpr u64 FLOOD_HASH_BITS = 20;
+
+internal
+bool is_ident_char(u64 c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Note: each identifier is a 6 character prefix and one final character. fnv1a_64 multiplies by
+// an odd number after each character, which is invertible, so the low bits that the final
+// character has to produce are known. A prefix works if its hash already has the right bits
+// above the low 8, and the final character that fixes the low 8 is an identifier character.
+internal
+Array<String> make_fnv_flood(u64 count)
+{
+    const u64 fnv_prime = 1099511628211UL;
+    const u64 mask = (1ull << FLOOD_HASH_BITS) - 1;
+    const byte alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+    const u64 alphabet_size = sizeof(alphabet) - 1;
+    
+    // Note: Newton's iteration for the inverse of the prime mod 2^64
+    u64 inverse = fnv_prime;
+    for(u64 i = 0; i < 6; ++i)
+    {
+        inverse *= 2 - fnv_prime * inverse;
+    }
+    u64 target = fnv1a_64(str_lit("flood")) & mask;
+    u64 needed = (target * inverse) & mask;
+    
+    Array<String> result;
+    result.count = 0;
+    result.data = mem_alloc(String, count);
+    byte *chars = mem_alloc(byte, count * 7);
+    
+    // Note: the prefixes are counted through, the first character is always a letter
+    byte prefix[6];
+    for(u64 n = 0; result.count < count; ++n)
+    {
+        u64 digits = n;
+        u64 hash = 14695981039346656037UL;
+        for(u64 i = 0; i < 6; ++i)
+        {
+            u64 radix = (i == 0) ? 52 : alphabet_size;
+            prefix[i] = alphabet[digits % radix];
+            digits /= radix;
+            hash ^= prefix[i];
+            hash *= fnv_prime;
+        }
+        
+        u64 last = (hash ^ needed) & 0xFF;
+        if(((hash ^ needed) & mask & ~0xFFull) == 0 && is_ident_char(last))
+        {
+            String str;
+            str.data = chars + result.count * 7;
+            str.count = 7;
+            copy_memory(str.data, prefix, 6);
+            str.data[6] = (byte)last;
+            assert((fnv1a_64(str) & mask) == target);
+            result.data[result.count++] = str;
+        }
+    }
+    return result;
+}
+
+internal
+void free_fnv_flood(Array<String> flood)
+{
+    mem_dealloc(flood.data[0].data, flood.count * 7);
+    mem_dealloc(flood.data, flood.count);
+}
+
+template<u64 (*H)(String)>
+internal
+void bench_flood_set(const byte *name, Array<String> identifiers)
+{
+    Hash_Set<Atom_Entry,String,get_str,H,operator==> set;
+    init_hash_set(&set);
+    defer {
+        free_hash_set(&set);
+    };
+    
+    for(u64 i = 0; i < identifiers.count; ++i)
+    {
+        Atom_Entry entry = {identifiers[i], {(u32)i}};
+        set_insert(&set, entry);
+    }
+    u64 probes = 0;
+    for(u64 i = 0; i < identifiers.count; ++i)
+    {
+        probes += set_probe_count(&set, identifiers[i], H(identifiers[i]));
+    }
+    
+    // Note: the work per lookup grows with the probes, so the rounds are scaled by them
+    u64 rounds = bench_rounds(probes + identifiers.count);
+    u64 insert_start = read_clock_ns();
+    for(u64 r = 0; r < rounds; ++r)
+    {
+        clear_hash_set(&set);
+        for(u64 i = 0; i < identifiers.count; ++i)
+        {
+            Atom_Entry entry = {identifiers[i], {(u32)i}};
+            set_insert(&set, entry);
+        }
+    }
+    u64 insert_elapsed = read_clock_ns() - insert_start;
+    
+    u64 checksum = 0;
+    u64 lookup_start = read_clock_ns();
+    for(u64 r = 0; r < rounds; ++r)
+    {
+        for(u64 i = 0; i < identifiers.count; ++i)
+        {
+            checksum += set_find(&set, identifiers[i])->atom.id;
+        }
+    }
+    u64 lookup_elapsed = read_clock_ns() - lookup_start;
+    
+    u64 ops = rounds * identifiers.count;
+    print("  %-12s %6lu keys: insert %9.2f ns/op, lookup %9.2f ns/op, %7.2f probes/lookup (checksum %llx)\n", name, identifiers.count, (double)insert_elapsed / ops, (double)lookup_elapsed / ops, (double)probes / identifiers.count, checksum);
+}
+
+// Note: identifiers made to collide under fnv1a_64, against the seeded hash_string
+internal
+bool bench_hash_flood(const byte *file_name)
+{
+    print("%lu low hash bits shared by all fnv1a_64 keys\n", FLOOD_HASH_BITS);
+    for(u64 count = 256; count <= 4096; count *= 4)
+    {
+        Array<String> flood = make_fnv_flood(count);
+        bench_flood_set<fnv1a_64>("fnv1a_64", flood);
+        bench_flood_set<hash_string>("hash_string", flood);
+        
+        Atom_Table atom_table;
+        init_atom_table(&atom_table, 128, 4096);
+        u64 rounds = bench_rounds(flood.count);
+        u64 start = read_clock_ns();
+        for(u64 r = 0; r < rounds; ++r)
+        {
+            reset_atom_table(&atom_table);
+            for(u64 i = 0; i < flood.count; ++i)
+            {
+                atomize_string(&atom_table, flood[i]);
+            }
+        }
+        u64 elapsed = read_clock_ns() - start;
+        free_atom_table(&atom_table);
+        
+        print("  %-12s %6lu keys: atomize %8.2f ns/op\n", "Atom_Table", flood.count, (double)elapsed / (rounds * flood.count));
+        free_fnv_flood(flood);
+    }
+    return true;
+}
+
+// Note: only compared with, never dereferenced
+global Expr_AST *bench_definition = (Expr_AST*)&bench_definition;
+
+internal
+Hashed_Scope *bench_make_scope(Pool_Allocator *pool, Hashed_Scope *parent, u64 index_in_parent, u32 first_atom, u32 entry_count)
+{
+    Hashed_Scope *hs = pool_alloc(Hashed_Scope, pool);
+    init_hashed_scope(hs, parent, index_in_parent, pool_allocator(pool));
+    for(u32 i = 0; i < entry_count; ++i)
+    {
+        Scope_Entry entry = {{first_atom + i}, 0, bench_definition};
+        scope_insert(hs, entry);
+    }
+    return hs;
+}
+
+internal
+void bench_scope_lookup(const byte *name, Hashed_Scope *hs, Atom key, u64 depth)
+{
+    u64 probes = scope_probe_count(hs, key, 0);
+    u64 rounds = bench_rounds(probes);
+    u64 hits = 0;
+    
+    u64 start = read_clock_ns();
+    for(u64 r = 0; r < rounds; ++r)
+    {
+        hits += (scope_find(hs, key, 0) != nullptr);
+    }
+    u64 elapsed = read_clock_ns() - start;
+    
+    print("  depth %5lu %-5s %9.2f ns/lookup, %6lu probes/lookup (%lu hits)\n", depth, name, (double)elapsed / rounds, probes, hits);
+}
+
+// Note: looks up the name in the outermost scope, and a missing name, from the innermost scope
+internal
+bool bench_scope_chain(const byte *file_name)
+{
+    Pool_Allocator pool;
+    pool_init(&pool, 1 << 20);
+    defer {
+        pool_release(&pool);
+    };
+    
+    u32 entry_counts[] = {1, 16};
+    for(u64 c = 0; c < static_array_size(entry_counts); ++c)
+    {
+        u32 entry_count = entry_counts[c];
+        print("%u entries per scope%s\n", entry_count, (entry_count <= SCOPE_INLINE_COUNT) ? " (inline)" : "");
+        for(u64 depth = 1; depth <= 4096; depth *= 8)
+        {
+            pool_reset(&pool);
+            Hashed_Scope *hs = nullptr;
+            for(u64 i = 0; i < depth; ++i)
+            {
+                hs = bench_make_scope(&pool, hs, 0, (u32)i * entry_count, entry_count);
+            }
+            bench_scope_lookup("outer", hs, {0}, depth);
+            bench_scope_lookup("miss", hs, {(u32)depth * entry_count}, depth);
+        }
+    }
+    return true;
+}
+
+// Note: many small scopes under one file scope, like the functions of a big file
+internal
+bool bench_scope_siblings(const byte *file_name)
+{
+    const u32 sibling_count = 100000;
+    const u32 parent_entry_count = 1024;
+    
+    Pool_Allocator pool;
+    pool_init(&pool, 1 << 20);
+    defer {
+        pool_release(&pool);
+    };
+    
+    u32 entry_counts[] = {2, 4, 8};
+    for(u64 c = 0; c < static_array_size(entry_counts); ++c)
+    {
+        u32 entry_count = entry_counts[c];
+        pool_reset(&pool);
+        Hashed_Scope *parent = bench_make_scope(&pool, nullptr, 0, 0, parent_entry_count);
+        Hashed_Scope **siblings = mem_alloc(Hashed_Scope*, sibling_count);
+        
+        u64 mark = pool.mark;
+        u64 start = read_clock_ns();
+        for(u32 i = 0; i < sibling_count; ++i)
+        {
+            siblings[i] = bench_make_scope(&pool, parent, 0, parent_entry_count + i * entry_count, entry_count);
+        }
+        u64 build_elapsed = read_clock_ns() - start;
+        u64 bytes = pool.mark - mark;
+        
+        // Note: each sibling looks up its last entry and an entry of the parent
+        u64 probes = 0;
+        for(u32 i = 0; i < sibling_count; ++i)
+        {
+            probes += scope_probe_count(siblings[i], {parent_entry_count + (i + 1) * entry_count - 1}, 0);
+            probes += scope_probe_count(siblings[i], {i % parent_entry_count}, 0);
+        }
+        
+        u64 hits = 0;
+        start = read_clock_ns();
+        for(u32 i = 0; i < sibling_count; ++i)
+        {
+            hits += (scope_find(siblings[i], {parent_entry_count + (i + 1) * entry_count - 1}, 0) != nullptr);
+            hits += (scope_find(siblings[i], {i % parent_entry_count}, 0) != nullptr);
+        }
+        u64 lookup_elapsed = read_clock_ns() - start;
+        
+        print("  %u siblings of %u entries: build %7.2f ns/scope, %6.1f bytes/scope, lookup %6.2f ns/op, %5.2f probes/lookup (%lu hits)\n", sibling_count, entry_count, (double)build_elapsed / sibling_count, (double)bytes / sibling_count, (double)lookup_elapsed / (2 * sibling_count), (double)probes / (2 * sibling_count), hits);
+        mem_dealloc(siblings, sibling_count);
+    }
+    return true;
+}
+
+typedef Hash_Set<Scope_Entry,Atom,get_key,compute_hash64,operator==> Bench_Atom_Set;
+
+// Note: growing one set from empty through every resize, and many small sets that stop just
+// before or just after a resize
+internal
+bool bench_resize_storm(const byte *file_name)
+{
+    {
+        const u32 count = 1 << 20;
+        Bench_Atom_Set set;
+        init_hash_set(&set);
+        
+        u64 resizes = 0;
+        u64 start = read_clock_ns();
+        for(u32 i = 0; i < count; ++i)
+        {
+            u64 size = set.set_size;
+            Scope_Entry entry = {{i}, 0, bench_definition};
+            set_insert(&set, entry);
+            resizes += (set.set_size != size);
+        }
+        u64 elapsed = read_clock_ns() - start;
+        
+        u64 probes = 0;
+        for(u32 i = 0; i < count; ++i)
+        {
+            probes += set_probe_count(&set, {i}, compute_hash64({i}));
+        }
+        print("  one set of %u: %6.2f ns/insert, %lu resizes, %4.2f probes/lookup at %.0f%% load\n", count, (double)elapsed / count, resizes, (double)probes / count, 100.0 * set.count / set.set_size);
+        free_hash_set(&set);
+    }
+    
+    Pool_Allocator pool;
+    pool_init(&pool, 1 << 20);
+    defer {
+        pool_release(&pool);
+    };
+    
+    // Note: a set of 16 slots grows at its 13th entry, one of 64 at its 49th
+    u32 sizes[] = {12, 13, 48, 49, 192, 193};
+    for(u64 s = 0; s < static_array_size(sizes); ++s)
+    {
+        u32 count = sizes[s];
+        u64 set_count = bench_rounds(count);
+        
+        u64 bytes = 0;
+        u64 start = read_clock_ns();
+        for(u64 n = 0; n < set_count; ++n)
+        {
+            if((n & 1023) == 0)
+            {
+                bytes += pool.mark;
+                pool_reset(&pool);
+            }
+            Bench_Atom_Set set;
+            init_hash_set(&set, 0, pool_allocator(&pool));
+            for(u32 i = 0; i < count; ++i)
+            {
+                Scope_Entry entry = {{i}, 0, bench_definition};
+                set_insert(&set, entry);
+            }
+        }
+        u64 elapsed = read_clock_ns() - start;
+        bytes += pool.mark;
+        pool_reset(&pool);
+        
+        print("  %lu sets of %3u: %6.2f ns/insert, %7.1f pool bytes/set\n", set_count, count, (double)elapsed / (set_count * count), (double)bytes / set_count);
+    }
+    return true;
+}
+
+// Note: a chain of declarations where each one is initialised from the next, ending in one with
+// a type, e.g. x0 := x1; x1 := x2; x2 : s64 = 1;
+// In reverse order, every declaration waits for one that comes after it in the file.
+internal
+u64 write_declaration_chain(byte *text, u64 length, bool reverse)
+{
+    byte *point = text;
+    if(reverse)
+    {
+        for(u64 i = 0; i < length; ++i)
+        {
+            point += stbsp_sprintf(point, "x%lu := x%lu;\n", i, i + 1);
+        }
+        point += stbsp_sprintf(point, "x%lu : s64 = 1;\n", length);
+    }
+    else
+    {
+        point += stbsp_sprintf(point, "x%lu : s64 = 1;\n", length);
+        for(u64 i = length; i > 0; --i)
+        {
+            point += stbsp_sprintf(point, "x%lu := x%lu;\n", i - 1, i);
+        }
+    }
+    return point - text;
+}
+
+// Note: only the typechecking is timed
+internal
+bool bench_typecheck_source(Compilation *comp, String source, u64 *elapsed_out)
+{
+    Dynamic_Array<Token> tokens = lex_string(source);
+    if(!tokens.data)
+    {
+        return false;
+    }
+    Parsing_Context parsing_ctx;
+    init_parsing_context(&parsing_ctx, source, tokens.array, &comp->ast_pool);
+    Dynamic_Array<Decl_AST*> decls = parse_tokens(&parsing_ctx);
+    array_free(&tokens);
+    defer {
+        array_free(&decls);
+    };
+    
+    Scoping_Context scoping_ctx;
+    init_scoping_context(&scoping_ctx, &comp->atom_table, &comp->ast_pool);
+    if(!create_scope_metadata(&scoping_ctx, decls.array))
+    {
+        return false;
+    }
+    
+    u64 start = read_clock_ns();
+    bool success = typecheck_all(&comp->ast_pool, &comp->atom_table, decls.array, comp->thread_count);
+    *elapsed_out += read_clock_ns() - start;
+    return success;
+}
+
+// Note: a scheduler that reruns every waiting job each round takes O(n^2) jobs for the reverse chain
+internal
+bool bench_typecheck_chain(const byte *file_name)
+{
+    Compilation comp;
+    init_compilation(&comp);
+    defer {
+        pool_release(&comp.ast_pool);
+        free_atom_table(&comp.atom_table);
+    };
+    
+    for(u64 length = 1000; length <= 100000; length *= 10)
+    {
+        // Note: no line of the chain is longer than 64 bytes
+        u64 capacity = (length + 1) * 64;
+        byte *text = mem_alloc(byte, capacity);
+        defer {
+            mem_dealloc(text, capacity);
+        };
+        
+        for(u64 reverse = 0; reverse < 2; ++reverse)
+        {
+            String source;
+            source.data = text;
+            source.count = write_declaration_chain(text, length, reverse);
+            
+            u64 rounds = max(100000 / length, (u64)1);
+            u64 elapsed = 0;
+            for(u64 r = 0; r < rounds; ++r)
+            {
+                reset_compilation(&comp);
+                if(!bench_typecheck_source(&comp, source, &elapsed))
+                {
+                    print_err("Typechecking the chain of %lu failed\n", length);
+                    return false;
+                }
+            }
+            
+            print("  chain of %6lu, %-7s order: %9.3f ms, %7.2f ns/decl\n", length, reverse ? "reverse" : "source", (double)elapsed / (rounds * 1000000.0), (double)elapsed / (rounds * (length + 1)));
+        }
+    }
+    return true;
+}
+
+// Note: typechecks the file on 1 to 8 threads. The timing includes starting the threads, so small
+// files mostly measure that
+internal
+bool bench_typecheck_threads(const byte *file_name)
+{
+    String source = read_entire_file(file_name);
+    if(!source.data)
+    {
+        print_err("Unable to read %s\n", file_name);
+        return false;
+    }
+    Compilation comp;
+    init_compilation(&comp);
+    defer {
+        mem_dealloc(source.data, source.count);
+        pool_release(&comp.ast_pool);
+        free_atom_table(&comp.atom_table);
+    };
+    
+    u64 rounds = 0;
+    for(u64 thread_count = 1; thread_count <= 8; thread_count *= 2)
+    {
+        comp.thread_count = thread_count;
+        u64 elapsed = 0;
+        if(rounds == 0)
+        {
+            // Note: as many rounds as fit in about a second on one thread
+            while(elapsed < 1000000000 && rounds < 1000)
+            {
+                reset_compilation(&comp);
+                if(!bench_typecheck_source(&comp, source, &elapsed))
+                {
+                    print_err("Typechecking %s failed\n", file_name);
+                    return false;
+                }
+                ++rounds;
+            }
+        }
+        else
+        {
+            for(u64 r = 0; r < rounds; ++r)
+            {
+                reset_compilation(&comp);
+                if(!bench_typecheck_source(&comp, source, &elapsed))
+                {
+                    print_err("Typechecking %s failed on %lu threads\n", file_name, thread_count);
+                    return false;
+                }
+            }
+        }
+        
+        print("  %lu threads: %9.3f ms\n", thread_count, (double)elapsed / (rounds * 1000000.0));
+    }
+    return true;
+}
+
+Benchmark benchmarks[] = {
+    {"atomize", bench_atomize},
+    {"atomize_threads", bench_atomize_threads},
+    {"hash_flood", bench_hash_flood},
+    {"scope_chain", bench_scope_chain},
+    {"scope_siblings", bench_scope_siblings},
+    {"resize_storm", bench_resize_storm},
+    {"typecheck_chain", bench_typecheck_chain},
+    {"typecheck_threads", bench_typecheck_threads},
+};
+
+bool run_benchmark(const byte *name, const byte *file_name)
+{
+    for(u64 i = 0; i < static_array_size(benchmarks); ++i)
+    {
+        if(c_string(name) == c_string(benchmarks[i].name))
+        {
+            return benchmarks[i].function(file_name);
+        }
+    }
+    
+    print_err("Unknown benchmark \"%s\", available:", name);
+    for(u64 i = 0; i < static_array_size(benchmarks); ++i)
+    {
+        print_err(" %s", benchmarks[i].name);
+    }
+    print_err("\n");
+    return false;
+}
@@ -0,0 +1,18 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "basic.h"
+
+// Note: benchmarks take their input from a source file, so they can be run on real code
+// Results are printed to stdout
+typedef bool Benchmark_Function(const byte *file_name);
+
+struct Benchmark
+{
+    const byte *name;
+    Benchmark_Function *function;
+};
+
+bool run_benchmark(const byte *name, const byte *file_name);
+
+#endif // BENCH_H
@@ -1,48 +1,245 @@
 
+thread_local Dynamic_Array<Diagnostic> *diagnostic_buffer = nullptr;
+
+internal
+void emit_diagnostic(AST *ast, byte *text)
+{
+    if(diagnostic_buffer)
+    {
+        String str = c_string(text);
+        Diagnostic diagnostic;
+        diagnostic.line_number = ast->line_number;
+        diagnostic.line_offset = ast->line_offset;
+        diagnostic.text.count = str.count;
+        diagnostic.text.data = mem_alloc(byte, str.count);
+        copy_memory(diagnostic.text.data, str.data, str.count);
+        array_add(diagnostic_buffer, diagnostic);
+    }
+    else
+    {
+        print_err("%s", text);
+    }
+}
+
 void report_error(const byte *msg, AST *ast)
 {
-    print_err("Error: %d:%d: %s\n", ast->line_number, ast->line_offset, msg);
+    byte text[1024];
+    stbsp_snprintf(text, sizeof(text), "Error: %d:%d: %s\n", ast->line_number, ast->line_offset, msg);
+    emit_diagnostic(ast, text);
 }
 
 void report_error(const byte *msg, AST *t1, AST *t2)
 {
-    print_err("Type Error: %d:%d vs %d:%d: %s\n", t1->line_number, t1->line_offset, t2->line_number, t2->line_offset, msg);
+    byte text[1024];
+    stbsp_snprintf(text, sizeof(text), "Type Error: %d:%d vs %d:%d: %s\n", t1->line_number, t1->line_offset, t2->line_number, t2->line_offset, msg);
+    emit_diagnostic(t1, text);
+}
+
+internal
+int compare_diagnostics(const void *a, const void *b)
+{
+    const Diagnostic *d_a = static_cast<const Diagnostic*>(a);
+    const Diagnostic *d_b = static_cast<const Diagnostic*>(b);
+    if(d_a->line_number != d_b->line_number)
+    {
+        return (d_a->line_number < d_b->line_number) ? -1 : 1;
+    }
+    if(d_a->line_offset != d_b->line_offset)
+    {
+        return (d_a->line_offset < d_b->line_offset) ? -1 : 1;
+    }
+    u64 count = (d_a->text.count < d_b->text.count) ? d_a->text.count : d_b->text.count;
+    int order = memcmp(d_a->text.data, d_b->text.data, count);
+    if(order != 0 || d_a->text.count == d_b->text.count)
+    {
+        return order;
+    }
+    return (d_a->text.count < d_b->text.count) ? -1 : 1;
+}
+
+void print_diagnostics(Array<Diagnostic> diagnostics)
+{
+    // Note: data is null when there are no diagnostics, which qsort does not allow
+    if(diagnostics.count > 1)
+    {
+        qsort(diagnostics.data, diagnostics.count, sizeof(Diagnostic), compare_diagnostics);
+    }
+    for(u64 i = 0; i < diagnostics.count; ++i)
+    {
+        // Note: a job that fails is retried, and may report the same thing again
+        if(i > 0 && diagnostics[i].text == diagnostics[i - 1].text)
+        {
+            continue;
+        }
+        print_err("%.*s", (int)diagnostics[i].text.count, diagnostics[i].text.data);
+    }
 }
 
 Job make_typecheck_job(Expr_AST *type, AST *ast, u32 stage)
 {
+    assert(((u64)ast & JOB_STAGE_MASK) == 0 && stage <= JOB_STAGE_MASK);
     Job result;
-    result.type = Job_Type::typecheck;
-    result.stage = stage;
-    result.typecheck.type = type;
-    result.typecheck.ast = ast;
+    result.ast_and_stage = (u64)ast | stage;
+    result.type = type;
     return result;
 }
 
-bool do_job(Context *ctx, Job job)
+
+internal
+void wake_jobs(Context *ctx, Expr_AST *expr)
 {
-    switch(job.type)
+    Wait_List *list = &ctx->wait_lists[expr->s];
+    for(u32 i = list->first; i != NO_PARKED_JOB; i = ctx->parked_jobs[i].next)
     {
-        case Job_Type::typecheck: {
-            return do_typecheck_job(ctx, job);
-        } break;
+        push_job(ctx->ready_jobs, ctx->parked_jobs[i].job);
+        --ctx->parked_count;
     }
-    assert(false);
-    return false;
+    list->first = NO_PARKED_JOB;
 }
 
-
-void set_resolved_type(Expr_AST *expr, Expr_AST *type)
+// Note: the count is stored last, with release semantics, so a thread that sees the type as
+// resolved also sees resolved_type, and everything the job wrote before it
+void set_resolved_type(Context *ctx, Expr_AST *expr, Expr_AST *type)
 {
-    expr->types.count = 1;
     expr->resolved_type = type;
+    if(ctx && ctx->worker)
+    {
+        publish_resolved_type(ctx->worker, expr);
+        return;
+    }
+    __atomic_store_n(&expr->types.count, 1, __ATOMIC_RELEASE);
+    if(expr->flags & EXPR_FLAG_HAS_WAITERS)
+    {
+        expr->flags &= ~EXPR_FLAG_HAS_WAITERS;
+        wake_jobs(ctx, expr);
+    }
 }
 
 bool type_resolved(Expr_AST *expr)
 {
-    return expr->types.count == 1;
+    return __atomic_load_n(&expr->types.count, __ATOMIC_ACQUIRE) == 1;
+}
+
+// Note: true if the job has to wait for expr to be resolved. Then it must yield, so that
+// add_waiting_job parks it on expr
+internal
+bool wait_for(Context *ctx, Expr_AST *expr)
+{
+    if(type_resolved(expr))
+    {
+        return false;
+    }
+    ctx->waiting_on = expr;
+    return true;
+}
+
+internal
+void park_job(Context *ctx, Expr_AST *expr, Job job)
+{
+    if(expr->s >= ctx->wait_lists.count)
+    {
+        // Note: typechecking makes some ASTs of its own, so there may be more serials than at the start
+        array_resize(&ctx->wait_lists, max((u64)next_serial, array_grow_size(ctx->wait_lists.count)));
+        ctx->wait_lists.count = ctx->wait_lists.allocated;
+    }
+    
+    u32 index = (u32)ctx->parked_jobs.count;
+    Parked_Job parked = {job, expr, NO_PARKED_JOB};
+    array_add(&ctx->parked_jobs, parked);
+    ++ctx->parked_count;
+    
+    Wait_List *list = &ctx->wait_lists[expr->s];
+    if(expr->flags & EXPR_FLAG_HAS_WAITERS)
+    {
+        ctx->parked_jobs[list->last].next = index;
+    }
+    else
+    {
+        expr->flags |= EXPR_FLAG_HAS_WAITERS;
+        list->first = index;
+    }
+    list->last = index;
+}
+
+// Note: a job that yielded through wait_for is parked until its node is resolved, so it is not
+// run again before it can make progress. Any other job is retried every round.
+internal
+void add_waiting_job(Context *ctx, Job job)
+{
+    Expr_AST *expr = ctx->waiting_on;
+    ctx->waiting_on = nullptr;
+    bool park = expr && !type_resolved(expr);
+    if(ctx->stats)
+    {
+        u64 type = (u64)job_ast(job)->type;
+        if(park)
+        {
+            ++ctx->stats->parked_counts[type];
+        }
+        else
+        {
+            ++ctx->stats->retried_counts[type];
+        }
+    }
+    if(park)
+    {
+        if(ctx->worker)
+        {
+            park_shared_job(ctx->worker, expr, job);
+        }
+        else
+        {
+            park_job(ctx, expr, job);
+        }
+    }
+    else
+    {
+        push_job(ctx->waiting_jobs, job);
+    }
+}
+
+// Note: the first job that refers to a declaration that was put off schedules it. Like a woken
+// job, it runs in the next round
+internal
+void schedule_referenced_decl(Context *ctx, Expr_AST *definition)
+{
+    Unchecked_Decls *unchecked = ctx->unchecked_decls;
+    if(definition->s >= unchecked->count || !__atomic_load_n(&unchecked->decls[definition->s], __ATOMIC_RELAXED))
+    {
+        return;
+    }
+    Decl_AST *decl = __atomic_exchange_n(&unchecked->decls[definition->s], (Decl_AST*)nullptr, __ATOMIC_RELAXED);
+    if(!decl)
+    {
+        return;
+    }
+    auto job = make_typecheck_job(nullptr, decl);
+    if(ctx->worker)
+    {
+        schedule_shared_jobs(ctx->worker, &job, 1);
+    }
+    else
+    {
+        push_job(ctx->ready_jobs, job);
+    }
 }
 
+// Note: typechecking may run on several threads, so unlike construct_ast, this takes the serial
+// atomically
+internal
+Unary_Operator_AST *make_pointer_type(Context *ctx, Expr_AST *operand)
+{
+    Unary_Operator_AST *pointer_type = pool_alloc(Unary_Operator_AST, ctx->ast_pool);
+    pointer_type->type = AST_Type::unary_ast;
+    pointer_type->flags = AST_FLAG_SYNTHETIC;
+    pointer_type->s = __atomic_fetch_add(&next_serial, 1, __ATOMIC_RELAXED);
+    pointer_type->line_number = 0;
+    pointer_type->line_offset = 0;
+    pointer_type->op = Unary_Operator::ref;
+    pointer_type->operand = operand;
+    set_resolved_type(ctx, pointer_type, &type_t_ast);
+    return pointer_type;
+}
 
 internal
 bool typecheck_decl(Context *ctx, u32 stage, Decl_AST *ast);
@@ -80,17 +277,19 @@ bool typecheck_bool(Context *ctx, Expr_AST *type, Bool_AST *bool_ast);
 internal
 Status combine_number_types(Context *ctx, Expr_AST *t1, Expr_AST *t2, Primitive_AST **out);
 
-bool do_typecheck_job(Context *ctx, Job job)
+internal
+bool run_typecheck_job(Context *ctx, Job job)
 {
-    Expr_AST *type = job.typecheck.type;
-    AST *ast = job.typecheck.ast;
+    Expr_AST *type = job.type;
+    AST *ast = job_ast(job);
+    u32 stage = job_stage(job);
     
     switch(ast->type)
     {
         case AST_Type::decl_ast: {
             Decl_AST *decl_ast = static_cast<Decl_AST*>(ast);
             assert(type == nullptr);
-            return typecheck_decl(ctx, job.stage, decl_ast);
+            return typecheck_decl(ctx, stage, decl_ast);
         } break;
         case AST_Type::block_ast: {
             Block_AST *block_ast = static_cast<Block_AST*>(ast);
@@ -126,7 +325,7 @@ bool do_typecheck_job(Context *ctx, Job job)
             {
                 // TODO: find best type? (change to u64 if out of range for s64?)
                 // If ints can't downcast, it might be a pain for 'it' to be big
-                set_resolved_type(for_ast->induction_var, &s64_t_ast);
+                set_resolved_type(ctx, for_ast->induction_var, &s64_t_ast);
                 
                 auto job = make_typecheck_job(&intlike_t_ast, for_ast->low_expr);
                 do_typecheck_job(ctx, job);
@@ -156,69 +355,69 @@ bool do_typecheck_job(Context *ctx, Job job)
         case AST_Type::assign_ast: {
             Assign_AST *assign_ast = static_cast<Assign_AST*>(ast);
             assert(type == nullptr);
-            return typecheck_assign(ctx, job.stage, assign_ast);
+            return typecheck_assign(ctx, stage, assign_ast);
         } break;
         case AST_Type::return_ast: {
             Return_AST *return_ast = static_cast<Return_AST*>(ast);
             assert(type == nullptr);
-            assert(job.stage == 0);
+            assert(stage == 0);
             return typecheck_return(ctx, return_ast);
         } break;
         
         case AST_Type::ident_ast: {
             Ident_AST *ident_ast = static_cast<Ident_AST*>(ast);
-            return typecheck_ident(ctx, job.stage, type, ident_ast);
+            return typecheck_ident(ctx, stage, type, ident_ast);
         } break;
         case AST_Type::function_type_ast: {
             Function_Type_AST *function_type_ast = static_cast<Function_Type_AST*>(ast);
-            return typecheck_function_type(ctx, job.stage, type, function_type_ast);
+            return typecheck_function_type(ctx, stage, type, function_type_ast);
         } break;
         case AST_Type::function_ast: {
             Function_AST *function_ast = static_cast<Function_AST*>(ast);
-            return typecheck_function(ctx, job.stage, type, function_ast);
+            return typecheck_function(ctx, stage, type, function_ast);
         } break;
         case AST_Type::function_call_ast: {
             Function_Call_AST *function_call_ast = static_cast<Function_Call_AST*>(ast);
-            return typecheck_function_call(ctx, job.stage, type, function_call_ast);
+            return typecheck_function_call(ctx, stage, type, function_call_ast);
         } break;
         case AST_Type::access_ast: {
             Access_AST *access_ast = static_cast<Access_AST*>(ast);
-            return typecheck_access(ctx, job.stage, type, access_ast);
+            return typecheck_access(ctx, stage, type, access_ast);
         } break;
         case AST_Type::binary_operator_ast: {
             Binary_Operator_AST *binop_ast = static_cast<Binary_Operator_AST*>(ast);
-            return typecheck_binop_ast(ctx, job.stage, type, binop_ast);
+            return typecheck_binop_ast(ctx, stage, type, binop_ast);
         } break;
         case AST_Type::number_ast: {
             Number_AST *number_ast = static_cast<Number_AST*>(ast);
-            assert(job.stage == 0);
+            assert(stage == 0);
             return typecheck_number(ctx, type, number_ast);
         } break;
         case AST_Type::enum_ast: {
             Enum_AST *enum_ast = static_cast<Enum_AST*>(ast);
-            return typecheck_enum(ctx, job.stage, type, enum_ast);
+            return typecheck_enum(ctx, stage, type, enum_ast);
         } break;
         case AST_Type::struct_ast: {
             Struct_AST *struct_ast = static_cast<Struct_AST*>(ast);
-            return typecheck_struct(ctx, job.stage, type, struct_ast);
+            return typecheck_struct(ctx, stage, type, struct_ast);
         } break;
         case AST_Type::unary_ast: {
             Unary_Operator_AST *unop_ast = static_cast<Unary_Operator_AST*>(ast);
-            return typecheck_unary(ctx, job.stage, type, unop_ast);
+            return typecheck_unary(ctx, stage, type, unop_ast);
         } break;
         case AST_Type::primitive_ast: {
             Primitive_AST *prim_ast = static_cast<Primitive_AST*>(ast);
-            assert(job.stage == 0);
+            assert(stage == 0);
             return typecheck_primitive(ctx, type, prim_ast);
         } break;
         case AST_Type::string_ast: {
             String_AST *string_ast = static_cast<String_AST*>(ast);
-            assert(job.stage == 0);
+            assert(stage == 0);
             return typecheck_string(ctx, type, string_ast);
         } break;
         case AST_Type::bool_ast: {
             Bool_AST *bool_ast = static_cast<Bool_AST*>(ast);
-            assert(job.stage == 0);
+            assert(stage == 0);
             return typecheck_bool(ctx, type, bool_ast);
         } break;
     }
@@ -227,6 +426,32 @@ bool do_typecheck_job(Context *ctx, Job job)
     return false;
 }
 
+internal
+bool do_profiled_typecheck_job(Context *ctx, Job job)
+{
+    u64 type = (u64)job_ast(job)->type;
+    u64 stage = min((u64)job_stage(job), TYPECHECK_STAGE_COUNT - 1);
+    ++ctx->stats->job_counts[type][stage];
+    
+    u64 outer_child_cycles = ctx->child_cycles;
+    ctx->child_cycles = 0;
+    u64 start = read_tsc();
+    bool progress = run_typecheck_job(ctx, job);
+    u64 elapsed = read_tsc() - start;
+    ctx->stats->cycles[type] += elapsed - ctx->child_cycles;
+    ctx->child_cycles = outer_child_cycles + elapsed;
+    return progress;
+}
+
+bool do_typecheck_job(Context *ctx, Job job)
+{
+    if(ctx->stats)
+    {
+        return do_profiled_typecheck_job(ctx, job);
+    }
+    return run_typecheck_job(ctx, job);
+}
+
 
 internal
 bool typecheck_decl(Context *ctx, u32 stage, Decl_AST *decl_ast)
@@ -244,7 +469,7 @@ bool typecheck_decl(Context *ctx, u32 stage, Decl_AST *decl_ast)
         } // fall through
         case 1: {
             new_stage = 1;
-            if(decl_ast->decl_type && !type_resolved(decl_ast->decl_type))
+            if(decl_ast->decl_type && wait_for(ctx, decl_ast->decl_type))
             {
                 break;
             }
@@ -262,7 +487,7 @@ bool typecheck_decl(Context *ctx, u32 stage, Decl_AST *decl_ast)
         } // fall through
         case 2: {
             new_stage = 2;
-            if(decl_ast->expr && !type_resolved(decl_ast->expr))
+            if(decl_ast->expr && wait_for(ctx, decl_ast->expr))
             {
                 break;
             }
@@ -272,15 +497,15 @@ bool typecheck_decl(Context *ctx, u32 stage, Decl_AST *decl_ast)
             }
             if(decl_ast->decl_type)
             {
-                set_resolved_type(&decl_ast->ident, decl_ast->decl_type);
+                set_resolved_type(ctx, &decl_ast->ident, decl_ast->decl_type);
             }
             else if(decl_ast->expr)
             {
-                set_resolved_type(&decl_ast->ident, decl_ast->expr->resolved_type);
+                set_resolved_type(ctx, &decl_ast->ident, decl_ast->expr->resolved_type);
             }
             else
             {
-                // TODO: this should be an enum value
+                // Note: an enum value without an expression, which typecheck_enum resolves
             }
             new_stage = 3;
         } // fall through
@@ -289,7 +514,7 @@ bool typecheck_decl(Context *ctx, u32 stage, Decl_AST *decl_ast)
     if(new_stage < 3)
     {
         auto job = make_typecheck_job(nullptr, decl_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -312,7 +537,7 @@ bool typecheck_assign(Context *ctx, u32 stage, Assign_AST *assign_ast)
                 auto job = make_typecheck_job(nullptr, assign_ast->lhs);
                 do_typecheck_job(ctx, job);
             }
-            if(!type_resolved(assign_ast->lhs))
+            if(wait_for(ctx, assign_ast->lhs))
             {
                 break;
             }
@@ -348,7 +573,7 @@ bool typecheck_assign(Context *ctx, u32 stage, Assign_AST *assign_ast)
                         auto job = make_typecheck_job(assign_ast->lhs->resolved_type, assign_ast->rhs);
                         do_typecheck_job(ctx, job);
                     }
-                    if(!type_resolved(assign_ast->rhs))
+                    if(wait_for(ctx, assign_ast->rhs))
                     {
                         goto finish;
                     }
@@ -372,7 +597,7 @@ bool typecheck_assign(Context *ctx, u32 stage, Assign_AST *assign_ast)
     if(new_stage < 4)
     {
         auto job = make_typecheck_job(nullptr, assign_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -385,7 +610,7 @@ bool typecheck_return(Context *ctx, Return_AST *return_ast)
     bool all_resolved = true;
     for(u64 i = 0; i < return_types.count; ++i)
     {
-        if(!type_resolved(return_types[i]))
+        if(wait_for(ctx, return_types[i]))
         {
             all_resolved = false;
             break;
@@ -403,7 +628,7 @@ bool typecheck_return(Context *ctx, Return_AST *return_ast)
         else
         {
             // TODO: better error reporting
-            print_err("Expected only one return type\n");
+            report_error("Expected only one return type", return_ast);
             ctx->success = false;
         }
         return true;
@@ -411,7 +636,7 @@ bool typecheck_return(Context *ctx, Return_AST *return_ast)
     else
     {
         auto job = make_typecheck_job(nullptr, return_ast);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
         return false;
     }
 }
@@ -434,7 +659,7 @@ bool typecheck_function_type(Context *ctx, u32 stage, Expr_AST *type, Function_T
             {
                 break;
             }
-            set_resolved_type(function_type_ast, &type_t_ast);
+            set_resolved_type(ctx, function_type_ast, &type_t_ast);
             add_job = true;
         } // fall through
         case 2: {
@@ -460,7 +685,7 @@ bool typecheck_function_type(Context *ctx, u32 stage, Expr_AST *type, Function_T
     if(new_stage < 3)
     {
         auto job = make_typecheck_job(type, function_type_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -478,8 +703,8 @@ bool typecheck_function(Context *ctx, u32 stage, Expr_AST *type, Function_AST *f
     {
         case 0: {
             function_ast->flags |= EXPR_FLAG_NOT_LVALUE;
-            set_resolved_type(function_ast->prototype, &type_t_ast);
-            set_resolved_type(function_ast, function_ast->prototype);
+            set_resolved_type(ctx, function_ast->prototype, &type_t_ast);
+            set_resolved_type(ctx, function_ast, function_ast->prototype);
             auto parameter_types = function_ast->prototype->parameter_types;
             for(u64 i = 0; i < parameter_types.count; ++i)
             {
@@ -505,7 +730,7 @@ bool typecheck_function(Context *ctx, u32 stage, Expr_AST *type, Function_AST *f
             for(u64 i = 0; i < parameter_types.count; ++i)
             {
                 auto param_type = parameter_types[i];
-                if(default_values[i] && param_type && !type_resolved(param_type))
+                if(default_values[i] && param_type && wait_for(ctx, param_type))
                 {
                     goto finish;
                 }
@@ -530,14 +755,19 @@ bool typecheck_function(Context *ctx, u32 stage, Expr_AST *type, Function_AST *f
                 {
                     auto val = default_values[i];
                     assert(val);
-                    if(type_resolved(val))
-                    {
-                        parameter_types[i] = val->resolved_type;
-                    }
-                    else
+                    if(wait_for(ctx, val))
                     {
                         goto finish;
                     }
+                    __atomic_store_n(&parameter_types[i], val->resolved_type, __ATOMIC_RELEASE);
+                }
+            }
+            // Note: a parameter is resolved to its type, so the type must be resolved first
+            for(u64 i = 0; i < parameter_types.count; ++i)
+            {
+                if(wait_for(ctx, parameter_types[i]))
+                {
+                    goto finish;
                 }
             }
             auto param_names = function_ast->param_names;
@@ -546,29 +776,40 @@ bool typecheck_function(Context *ctx, u32 stage, Expr_AST *type, Function_AST *f
                 assert(parameter_types[i]);
                 if(param_names[i])
                 {
-                    set_resolved_type(param_names[i], parameter_types[i]);
+                    set_resolved_type(ctx, param_names[i], parameter_types[i]);
                 }
             }
-            auto job = make_typecheck_job(nullptr, function_ast->block);
-            do_typecheck_job(ctx, job);
             add_job = true;
         } // fall through
         case 3: {
             new_stage = 3;
+            // Note: while the declarations are seeded, the bodies are put off until every
+            // prototype has been checked, so that most calls in them don't have to wait
+            if(ctx->deferred_bodies)
+            {
+                push_job(ctx->deferred_bodies, make_typecheck_job(type, function_ast, 3));
+                return new_stage != stage;
+            }
+            auto job = make_typecheck_job(nullptr, function_ast->block);
+            do_typecheck_job(ctx, job);
+            add_job = true;
+        } // fall through
+        case 4: {
+            new_stage = 4;
             Status match = types_match(ctx, type, function_ast->resolved_type);
             if(match != Status::good)
             {
                 break;
             }
-            new_stage = 4;
+            new_stage = 5;
         } // fall through
     }
     finish:
     
-    if(new_stage < 4)
+    if(new_stage < 5)
     {
         auto job = make_typecheck_job(type, function_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -595,7 +836,7 @@ bool typecheck_function_call(Context *ctx, u32 stage, Expr_AST *type, Function_C
                 auto job = make_typecheck_job(nullptr, function);
                 do_typecheck_job(ctx, job);
             }
-            if(!type_resolved(function))
+            if(wait_for(ctx, function))
             {
                 break;
             }
@@ -620,18 +861,23 @@ bool typecheck_function_call(Context *ctx, u32 stage, Expr_AST *type, Function_C
             auto return_types = function_type->return_types;
             for(u64 i = 0; i < return_types.count; ++i)
             {
-                if(!type_resolved(return_types[i]))
+                if(wait_for(ctx, return_types[i]))
                 {
                     goto finish;
                 }
             }
             // TODO support multiple return types
-            set_resolved_type(function_call_ast, return_types[0]);
+            // Note: a job that waits for an argument runs this again, while other threads may
+            // already read the type
+            if(!type_resolved(function_call_ast))
+            {
+                set_resolved_type(ctx, function_call_ast, return_types[0]);
+            }
             
             auto param_types = function_type->parameter_types;
             for(u64 i = 0; i < param_types.count; ++i)
             {
-                if(!type_resolved(param_types[i]))
+                if(wait_for(ctx, param_types[i]))
                 {
                     goto finish;
                 }
@@ -658,7 +904,7 @@ bool typecheck_function_call(Context *ctx, u32 stage, Expr_AST *type, Function_C
     if(new_stage < 3)
     {
         auto job = make_typecheck_job(type, function_call_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -682,7 +928,7 @@ bool typecheck_access(Context *ctx, u32 stage, Expr_AST *type, Access_AST *acces
                 auto job = make_typecheck_job(nullptr, lhs);
                 do_typecheck_job(ctx, job);
             }
-            if(!type_resolved(lhs))
+            if(wait_for(ctx, lhs))
             {
                 break;
             }
@@ -717,16 +963,33 @@ bool typecheck_access(Context *ctx, u32 stage, Expr_AST *type, Access_AST *acces
             if(lookup_type->type == AST_Type::struct_ast)
             {
                 Struct_AST *struct_ast = static_cast<Struct_AST*>(lookup_type);
-                expr = scope_find(struct_ast->constant_scope, access_ast->atom, 0, false);
-                if(!expr)
+                u32 member = member_index_find(&struct_ast->member_index, access_ast->atom);
+                if(member == MEMBER_NOT_FOUND)
+                {
+                    expr = nullptr;
+                }
+                else if(member < struct_ast->constants.count)
+                {
+                    expr = &struct_ast->constants[member]->ident;
+                }
+                else
                 {
-                    expr = scope_find(struct_ast->field_scope, access_ast->atom, 0, false);
+                    // Note: wait for the offsets, so the field is resolved all at once
+                    if(!__atomic_load_n(&struct_ast->layout.alignment, __ATOMIC_ACQUIRE))
+                    {
+                        break;
+                    }
+                    u32 field_index = member - (u32)struct_ast->constants.count;
+                    expr = &struct_ast->fields[field_index]->ident;
+                    access_ast->field_index = field_index;
+                    access_ast->field_offset = struct_ast->layout.field_offsets[field_index];
                 }
             }
             else if(lookup_type->type == AST_Type::enum_ast && !pointer)
             {
                 Enum_AST *enum_ast = static_cast<Enum_AST*>(lookup_type);
-                expr = scope_find(enum_ast->scope, access_ast->atom, 0, false);
+                u32 ordinal = member_index_find(&enum_ast->member_index, access_ast->atom);
+                expr = (ordinal == MEMBER_NOT_FOUND) ? nullptr : &enum_ast->values[ordinal]->ident;
             }
             else
             {
@@ -756,11 +1019,11 @@ bool typecheck_access(Context *ctx, u32 stage, Expr_AST *type, Access_AST *acces
         } // fall through
         case 3: {
             new_stage = 3;
-            if(!type_resolved(access_ast->expr))
+            if(wait_for(ctx, access_ast->expr))
             {
                 break;
             }
-            set_resolved_type(access_ast, access_ast->expr->resolved_type);
+            set_resolved_type(ctx, access_ast, access_ast->expr->resolved_type);
             new_stage = 4;
         } // fall through
     }
@@ -768,7 +1031,7 @@ bool typecheck_access(Context *ctx, u32 stage, Expr_AST *type, Access_AST *acces
     if(new_stage < 4)
     {
         auto job = make_typecheck_job(type, access_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -814,7 +1077,7 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
                     {
                         binop_type = &bool8_t_ast;
                     }
-                    set_resolved_type(binop_ast, binop_type);
+                    set_resolved_type(ctx, binop_ast, binop_type);
                     add_job = true;
                 } // fall through
                 case 2: {
@@ -828,11 +1091,11 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
                 } // fall through
                 case 3: {
                     new_stage = 3;
-                    if(!type_resolved(binop_ast->lhs))
+                    if(wait_for(ctx, binop_ast->lhs))
                     {
                         goto finish;
                     }
-                    if(!type_resolved(binop_ast->rhs))
+                    if(wait_for(ctx, binop_ast->rhs))
                     {
                         goto finish;
                     }
@@ -884,11 +1147,11 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
                 } // fall through
                 case 2: {
                     new_stage = 2;
-                    if(!type_resolved(binop_ast->lhs))
+                    if(wait_for(ctx, binop_ast->lhs))
                     {
                         goto finish;
                     }
-                    if(!type_resolved(binop_ast->rhs))
+                    if(wait_for(ctx, binop_ast->rhs))
                     {
                         goto finish;
                     }
@@ -906,7 +1169,7 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
                             goto finish;
                         }
                     }
-                    set_resolved_type(binop_ast, combined);
+                    set_resolved_type(ctx, binop_ast, combined);
                     new_stage = 3;
                 } // fall through
             }
@@ -924,12 +1187,7 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
                     if(type)
                     {
                         // TODO: maybe make a canonical type table, so not every & makes a new type in memory
-                        Unary_Operator_AST *type_to_deref = construct_ast(ctx->ast_pool, Unary_Operator_AST, 0, 0);
-                        type_to_deref->flags |= AST_FLAG_SYNTHETIC;
-                        set_resolved_type(type_to_deref, &type_t_ast);
-                        type_to_deref->op = Unary_Operator::ref;
-                        type_to_deref->operand = type;
-                        type_to_check = type_to_deref;
+                        type_to_check = make_pointer_type(ctx, type);
                     }
                     auto job = make_typecheck_job(type_to_check, binop_ast->lhs);
                     do_typecheck_job(ctx, job);
@@ -938,7 +1196,7 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
                 } // fall through
                 case 1: {
                     new_stage = 1;
-                    if(!type_resolved(binop_ast->lhs))
+                    if(wait_for(ctx, binop_ast->lhs))
                     {
                         goto finish;
                     }
@@ -962,7 +1220,7 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
                     {
                         goto finish;
                     }
-                    set_resolved_type(binop_ast, lhs_type->operand);
+                    set_resolved_type(ctx, binop_ast, lhs_type->operand);
                     new_stage = 2;
                 } // fall through
             }
@@ -991,7 +1249,7 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
             do_typecheck_job(ctx, job);
             
             // TODO: make sure this is a concrete bool type, not boollike
-            set_resolved_type(binop_ast, bool_type);
+            set_resolved_type(ctx, binop_ast, bool_type);
             new_stage = 1;
         } break;
     }
@@ -1000,7 +1258,7 @@ bool typecheck_binop_ast(Context *ctx, u32 stage, Expr_AST *type, Binary_Operato
     if(new_stage < done_stage)
     {
         auto job = make_typecheck_job(type, binop_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -1058,11 +1316,11 @@ bool typecheck_number(Context *ctx, Expr_AST *type, Number_AST *number_ast)
             switch(size)
             {
                 case PRIM_SIZE4: {
-                    set_resolved_type(number_ast, &f32_t_ast);
+                    set_resolved_type(ctx, number_ast, &f32_t_ast);
                 } break;
                 case PRIM_NO_SIZE:
                 case PRIM_SIZE8: {
-                    set_resolved_type(number_ast, &f64_t_ast);
+                    set_resolved_type(ctx, number_ast, &f64_t_ast);
                 } break;
                 default: {
                     // Note: no floatlike type should have a different size
@@ -1084,17 +1342,17 @@ bool typecheck_number(Context *ctx, Expr_AST *type, Number_AST *number_ast)
                 switch(size)
                 {
                     case PRIM_SIZE1: {
-                        set_resolved_type(number_ast, &u8_t_ast);
+                        set_resolved_type(ctx, number_ast, &u8_t_ast);
                     } break;
                     case PRIM_SIZE2: {
-                        set_resolved_type(number_ast, &u16_t_ast);
+                        set_resolved_type(ctx, number_ast, &u16_t_ast);
                     } break;
                     case PRIM_SIZE4: {
-                        set_resolved_type(number_ast, &u32_t_ast);
+                        set_resolved_type(ctx, number_ast, &u32_t_ast);
                     } break;
                     case PRIM_NO_SIZE:
                     case PRIM_SIZE8: {
-                        set_resolved_type(number_ast, &u64_t_ast);
+                        set_resolved_type(ctx, number_ast, &u64_t_ast);
                     } break;
                     default: {
                         assert(false);
@@ -1107,17 +1365,17 @@ bool typecheck_number(Context *ctx, Expr_AST *type, Number_AST *number_ast)
                 switch(size)
                 {
                     case PRIM_SIZE1: {
-                        set_resolved_type(number_ast, &s8_t_ast);
+                        set_resolved_type(ctx, number_ast, &s8_t_ast);
                     } break;
                     case PRIM_SIZE2: {
-                        set_resolved_type(number_ast, &s16_t_ast);
+                        set_resolved_type(ctx, number_ast, &s16_t_ast);
                     } break;
                     case PRIM_SIZE4: {
-                        set_resolved_type(number_ast, &s32_t_ast);
+                        set_resolved_type(ctx, number_ast, &s32_t_ast);
                     } break;
                     case PRIM_NO_SIZE:
                     case PRIM_SIZE8: {
-                        set_resolved_type(number_ast, &s64_t_ast);
+                        set_resolved_type(ctx, number_ast, &s64_t_ast);
                     } break;
                     default: {
                         assert(false);
@@ -1135,96 +1393,515 @@ bool typecheck_number(Context *ctx, Expr_AST *type, Number_AST *number_ast)
     else
     {
         auto job = make_typecheck_job(type, number_ast);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
         return false;
     }
 }
 
+// Note: only handles what enum values need, integer literals and arithmetic on other constants
+// An enum value without an expression is the previous value + 1, so enum_ast is needed to find
+// the value of one that is referred to. Only the first value_count of its values are known yet.
 internal
-bool typecheck_enum(Context *ctx, u32 stage, Expr_AST *type, Enum_AST *enum_ast)
+Status evaluate_integer_constant(Context *ctx, Expr_AST *expr, Enum_AST *enum_ast, u64 value_count, s64 *out)
 {
-    u32 new_stage = 0;
-    switch(stage)
+    switch(expr->type)
     {
-        case 0: {
-            if(type)
+        case AST_Type::number_ast: {
+            Number_AST *number_ast = static_cast<Number_AST*>(expr);
+            if(number_ast->flags & NUMBER_FLAG_FLOATLIKE)
             {
-                Status status = types_match(ctx, type, &type_t_ast);
-                if(status != Status::good)
+                break;
+            }
+            if(number_ast->int_value > (u64)INT64_MAX)
+            {
+                goto does_not_fit;
+            }
+            *out = (s64)number_ast->int_value;
+            return Status::good;
+        } break;
+        case AST_Type::ident_ast:
+        case AST_Type::access_ast: {
+            Ident_AST *definition;
+            if(expr->type == AST_Type::ident_ast)
+            {
+                definition = static_cast<Ident_AST*>(ident_get_expr(static_cast<Ident_AST*>(expr)));
+            }
+            else
+            {
+                definition = static_cast<Ident_AST*>(static_cast<Access_AST*>(expr)->expr);
+            }
+            if(!(definition->flags & EXPR_FLAG_CONSTANT))
+            {
+                break;
+            }
+            
+            u32 ordinal = member_index_find(&enum_ast->member_index, definition->atom);
+            if(ordinal != MEMBER_NOT_FOUND && &enum_ast->values[ordinal]->ident == definition)
+            {
+                if(ordinal >= value_count)
                 {
-                    break;
+                    report_error("Enum value refers to a later value", expr);
+                    ctx->success = false;
+                    return Status::bad;
                 }
+                *out = enum_ast->table.values[ordinal];
+                return Status::good;
             }
-        } // fall through
-        case 1: {
-            new_stage = 1;
-            set_resolved_type(enum_ast, &type_t_ast);
-            for(u64 i = 0; i < enum_ast->values.count; ++i)
+            
+            Expr_AST *definition_expr = ident_get_expr(definition);
+            if(!definition_expr)
             {
-                // TODO: enum values should all have the same type
-                auto job = make_typecheck_job(nullptr, enum_ast->values[i]);
-                do_typecheck_job(ctx, job);
+                break;
             }
-            new_stage = 2;
-        } // fall through
-    }
-    
-    if(new_stage < 2)
-    {
-        auto job = make_typecheck_job(type, enum_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
-    }
-    return new_stage != stage;
-}
-
-internal
-bool typecheck_struct(Context *ctx, u32 stage, Expr_AST *type, Struct_AST *struct_ast)
-{
-    u32 new_stage = 0;
-    switch(stage)
-    {
-        case 0: {
-            if(type)
+            return evaluate_integer_constant(ctx, definition_expr, enum_ast, value_count, out);
+        } break;
+        case AST_Type::unary_ast: {
+            Unary_Operator_AST *unop_ast = static_cast<Unary_Operator_AST*>(expr);
+            if(unop_ast->op != Unary_Operator::plus && unop_ast->op != Unary_Operator::minus)
             {
-                Status status = types_match(ctx, type, &type_t_ast);
-                if(status != Status::good)
+                break;
+            }
+            s64 operand;
+            Status status = evaluate_integer_constant(ctx, unop_ast->operand, enum_ast, value_count, &operand);
+            if(status != Status::good)
+            {
+                return status;
+            }
+            if(unop_ast->op == Unary_Operator::minus && __builtin_sub_overflow((s64)0, operand, out))
+            {
+                goto does_not_fit;
+            }
+            if(unop_ast->op == Unary_Operator::plus)
+            {
+                *out = operand;
+            }
+            return Status::good;
+        } break;
+        case AST_Type::binary_operator_ast: {
+            Binary_Operator_AST *binop_ast = static_cast<Binary_Operator_AST*>(expr);
+            s64 lhs, rhs;
+            Status status = evaluate_integer_constant(ctx, binop_ast->lhs, enum_ast, value_count, &lhs);
+            if(status != Status::good)
+            {
+                return status;
+            }
+            status = evaluate_integer_constant(ctx, binop_ast->rhs, enum_ast, value_count, &rhs);
+            if(status != Status::good)
+            {
+                return status;
+            }
+            
+            // Note: the values are s64, a result that does not fit is an error rather than wrapping
+            bool overflow = false;
+            if(binop_ast->op == Binary_Operator::add)
+            {
+                overflow = __builtin_add_overflow(lhs, rhs, out);
+            }
+            else if(binop_ast->op == Binary_Operator::sub)
+            {
+                overflow = __builtin_sub_overflow(lhs, rhs, out);
+            }
+            else if(binop_ast->op == Binary_Operator::mul)
+            {
+                overflow = __builtin_mul_overflow(lhs, rhs, out);
+            }
+            else if(binop_ast->op == Binary_Operator::div)
+            {
+                if(rhs == 0)
                 {
-                    break;
+                    report_error("Enum value divides by zero", expr);
+                    ctx->success = false;
+                    return Status::bad;
+                }
+                overflow = (lhs == INT64_MIN && rhs == -1);
+                if(!overflow)
+                {
+                    *out = lhs / rhs;
                 }
             }
-        } // fall through
-        case 1: {
-            new_stage = 1;
-            set_resolved_type(struct_ast, &type_t_ast);
-            
-            for(u64 i = 0; i < struct_ast->constants.count; ++i)
+            else
             {
-                auto job = make_typecheck_job(nullptr, struct_ast->constants[i]);
-                do_typecheck_job(ctx, job);
+                break;
             }
-            for(u64 i = 0; i < struct_ast->fields.count; ++i)
+            if(overflow)
             {
-                auto job = make_typecheck_job(nullptr, struct_ast->fields[i]);
-                do_typecheck_job(ctx, job);
+                goto does_not_fit;
             }
-            new_stage = 2;
-        } // fall through
-        // TODO: size struct
+            return Status::good;
+        } break;
+        default: {
+        } break;
     }
     
-    if(new_stage < 2)
-    {
-        auto job = make_typecheck_job(type, struct_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
-    }
-    return new_stage != stage;
+    report_error("Expected a constant integer", expr);
+    ctx->success = false;
+    return Status::bad;
+    
+does_not_fit:
+    report_error("Enum value does not fit in 64 bits", expr);
+    ctx->success = false;
+    return Status::bad;
 }
 
 internal
-bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST *unop_ast)
+Status compute_enum_table(Context *ctx, Enum_AST *enum_ast)
 {
-    u32 new_stage = 0;
-    u32 done_stage;
+    Enum_Table *table = &enum_ast->table;
+    u64 value_count = enum_ast->values.count;
+    
+    Expr_AST *underlying_type = enum_ast->underlying_type;
+    if(underlying_type && wait_for(ctx, underlying_type))
+    {
+        return Status::yield;
+    }
+    for(u64 i = 0; i < value_count; ++i)
+    {
+        Expr_AST *expr = enum_ast->values[i]->expr;
+        if(expr && wait_for(ctx, expr))
+        {
+            return Status::yield;
+        }
+    }
+    
+    u64 prim = PRIM_S64;
+    if(underlying_type)
+    {
+        Expr_AST *reduced;
+        Status status = reduce_type(ctx, underlying_type, &reduced);
+        if(status != Status::good)
+        {
+            return status;
+        }
+        if(reduced->type != AST_Type::primitive_ast ||
+           !(static_cast<Primitive_AST*>(reduced)->primitive & PRIM_SIGN_MASK))
+        {
+            report_error("Expected an integer type", underlying_type);
+            ctx->success = false;
+            return Status::bad;
+        }
+        prim = static_cast<Primitive_AST*>(reduced)->primitive;
+    }
+    
+    // Note: the values are s64, so a u64 enum can't use the top half of its range
+    u64 bits = 8ull << ((prim & PRIM_SIZE_MASK) - 1);
+    s64 min_allowed = 0;
+    s64 max_allowed = INT64_MAX;
+    if(prim & PRIM_SIGNED_INT)
+    {
+        min_allowed = (bits < 64) ? -(1ll << (bits - 1)) : INT64_MIN;
+        max_allowed = (bits < 64) ? (1ll << (bits - 1)) - 1 : INT64_MAX;
+    }
+    else if(bits < 64)
+    {
+        max_allowed = (1ll << bits) - 1;
+    }
+    
+    table->values = pool_alloc(s64, value_count, ctx->ast_pool);
+    table->min_value = 0;
+    table->max_value = 0;
+    for(u64 i = 0; i < value_count; ++i)
+    {
+        s64 value = 0;
+        Expr_AST *expr = enum_ast->values[i]->expr;
+        if(!expr && i > 0)
+        {
+            if(table->values[i - 1] == max_allowed)
+            {
+                report_error("Enum value does not fit in the underlying type", enum_ast->values[i]);
+                ctx->success = false;
+                table->values = nullptr;
+                return Status::bad;
+            }
+            value = table->values[i - 1] + 1;
+        }
+        if(expr)
+        {
+            Status status = evaluate_integer_constant(ctx, expr, enum_ast, i, &value);
+            if(status != Status::good)
+            {
+                table->values = nullptr;
+                return status;
+            }
+        }
+        
+        if(value < min_allowed || value > max_allowed)
+        {
+            report_error("Enum value does not fit in the underlying type", enum_ast->values[i]);
+            ctx->success = false;
+            table->values = nullptr;
+            return Status::bad;
+        }
+        
+        table->values[i] = value;
+        table->min_value = (i > 0 && table->min_value < value) ? table->min_value : value;
+        table->max_value = (i > 0 && table->max_value > value) ? table->max_value : value;
+    }
+    
+    table->contiguous = false;
+    // Note: the span is computed unsigned, since it may not fit in an s64
+    if(value_count > 0 && (u64)table->max_value - (u64)table->min_value == value_count - 1)
+    {
+        bool *used = mem_alloc(bool, value_count);
+        zero_memory(used, value_count);
+        table->contiguous = true;
+        for(u64 i = 0; i < value_count; ++i)
+        {
+            u64 offset = (u64)table->values[i] - (u64)table->min_value;
+            table->contiguous = table->contiguous && !used[offset];
+            used[offset] = true;
+        }
+        mem_dealloc(used, value_count);
+    }
+    return Status::good;
+}
+
+internal
+bool typecheck_enum(Context *ctx, u32 stage, Expr_AST *type, Enum_AST *enum_ast)
+{
+    u32 new_stage = 0;
+    switch(stage)
+    {
+        case 0: {
+            if(type)
+            {
+                Status status = types_match(ctx, type, &type_t_ast);
+                if(status != Status::good)
+                {
+                    break;
+                }
+            }
+        } // fall through
+        case 1: {
+            new_stage = 1;
+            set_resolved_type(ctx, enum_ast, &type_t_ast);
+            if(enum_ast->underlying_type)
+            {
+                auto job = make_typecheck_job(&type_t_ast, enum_ast->underlying_type);
+                do_typecheck_job(ctx, job);
+            }
+        } // fall through
+        case 2: {
+            new_stage = 2;
+            Expr_AST *underlying_type = enum_ast->underlying_type;
+            if(underlying_type && wait_for(ctx, underlying_type))
+            {
+                break;
+            }
+            // Note: a value without an expression has the type the values are stored as. It is
+            // resolved before the other values are checked, since they may refer to it
+            for(u64 i = 0; i < enum_ast->values.count; ++i)
+            {
+                Decl_AST *value = enum_ast->values[i];
+                if(!value->expr)
+                {
+                    set_resolved_type(ctx, &value->ident, underlying_type ? underlying_type : &s64_t_ast);
+                }
+            }
+            for(u64 i = 0; i < enum_ast->values.count; ++i)
+            {
+                // TODO: enum values should all have the same type
+                auto job = make_typecheck_job(nullptr, enum_ast->values[i]);
+                do_typecheck_job(ctx, job);
+            }
+        } // fall through
+        case 3: {
+            new_stage = 3;
+            Status status = compute_enum_table(ctx, enum_ast);
+            if(status != Status::good)
+            {
+                break;
+            }
+            new_stage = 4;
+        } // fall through
+    }
+    
+    if(new_stage < 4)
+    {
+        auto job = make_typecheck_job(type, enum_ast, new_stage);
+        add_waiting_job(ctx, job);
+    }
+    return new_stage != stage;
+}
+
+internal
+u64 align_up(u64 offset, u64 alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Note: yields while type is, or refers to, a struct that is not laid out yet
+internal
+Status type_size(Context *ctx, Expr_AST *type, u64 *size_out, u64 *alignment_out)
+{
+    Expr_AST *reduced;
+    Status status = reduce_type(ctx, type, &reduced);
+    if(status != Status::good)
+    {
+        return status;
+    }
+    
+    switch(reduced->type)
+    {
+        case AST_Type::primitive_ast: {
+            u64 prim = static_cast<Primitive_AST*>(reduced)->primitive;
+            u64 size = 8;
+            if(prim == PRIM_VOID)
+            {
+                report_error("Type void has no size", type);
+                ctx->success = false;
+                return Status::bad;
+            }
+            else if((prim & PRIM_SIZE_MASK) != PRIM_NO_SIZE)
+            {
+                size = 1ull << ((prim & PRIM_SIZE_MASK) - 1);
+            }
+            else if((prim & PRIM_LIKE_MASK) == PRIM_BOOLLIKE)
+            {
+                size = 1;
+            }
+            // Note: otherwise an abstract number, which is 64 bits when it is made concrete
+            *size_out = size;
+            *alignment_out = size;
+            return Status::good;
+        } break;
+        case AST_Type::unary_ast:
+        case AST_Type::function_type_ast: {
+            *size_out = 8;
+            *alignment_out = 8;
+            return Status::good;
+        } break;
+        case AST_Type::enum_ast: {
+            Enum_AST *enum_ast = static_cast<Enum_AST*>(reduced);
+            if(!enum_ast->underlying_type)
+            {
+                *size_out = 8;
+                *alignment_out = 8;
+                return Status::good;
+            }
+            if(wait_for(ctx, enum_ast->underlying_type))
+            {
+                return Status::yield;
+            }
+            return type_size(ctx, enum_ast->underlying_type, size_out, alignment_out);
+        } break;
+        case AST_Type::struct_ast: {
+            Struct_AST *struct_ast = static_cast<Struct_AST*>(reduced);
+            if(!__atomic_load_n(&struct_ast->layout.alignment, __ATOMIC_ACQUIRE))
+            {
+                return Status::yield;
+            }
+            *size_out = struct_ast->layout.size;
+            *alignment_out = struct_ast->layout.alignment;
+            return Status::good;
+        } break;
+        default: {
+            assert(false);
+        } break;
+    }
+    return Status::bad;
+}
+
+// Note: lays the fields out in order, each at the next offset that suits its alignment, like C
+internal
+Status compute_struct_layout(Context *ctx, Struct_AST *struct_ast)
+{
+    Struct_Layout *layout = &struct_ast->layout;
+    u64 field_count = struct_ast->fields.count;
+    
+    for(u64 i = 0; i < field_count; ++i)
+    {
+        if(wait_for(ctx, &struct_ast->fields[i]->ident))
+        {
+            return Status::yield;
+        }
+    }
+    
+    if(!layout->field_offsets)
+    {
+        layout->field_offsets = pool_alloc(u64, field_count, ctx->ast_pool);
+        layout->field_sizes = pool_alloc(u64, field_count, ctx->ast_pool);
+    }
+    
+    u64 offset = 0;
+    u64 alignment = 1;
+    for(u64 i = 0; i < field_count; ++i)
+    {
+        u64 field_size, field_alignment;
+        Status status = type_size(ctx, struct_ast->fields[i]->ident.resolved_type, &field_size, &field_alignment);
+        if(status != Status::good)
+        {
+            return status;
+        }
+        
+        offset = align_up(offset, field_alignment);
+        layout->field_offsets[i] = offset;
+        layout->field_sizes[i] = field_size;
+        offset += field_size;
+        alignment = max(alignment, field_alignment);
+    }
+    
+    // Note: the alignment is stored last, with release semantics, since a nonzero alignment is what
+    // tells other jobs that the layout is done
+    layout->size = align_up(offset, alignment);
+    __atomic_store_n(&layout->alignment, alignment, __ATOMIC_RELEASE);
+    return Status::good;
+}
+
+internal
+bool typecheck_struct(Context *ctx, u32 stage, Expr_AST *type, Struct_AST *struct_ast)
+{
+    u32 new_stage = 0;
+    switch(stage)
+    {
+        case 0: {
+            if(type)
+            {
+                Status status = types_match(ctx, type, &type_t_ast);
+                if(status != Status::good)
+                {
+                    break;
+                }
+            }
+        } // fall through
+        case 1: {
+            new_stage = 1;
+            set_resolved_type(ctx, struct_ast, &type_t_ast);
+            
+            for(u64 i = 0; i < struct_ast->constants.count; ++i)
+            {
+                auto job = make_typecheck_job(nullptr, struct_ast->constants[i]);
+                do_typecheck_job(ctx, job);
+            }
+            for(u64 i = 0; i < struct_ast->fields.count; ++i)
+            {
+                auto job = make_typecheck_job(nullptr, struct_ast->fields[i]);
+                do_typecheck_job(ctx, job);
+            }
+        } // fall through
+        case 2: {
+            new_stage = 2;
+            Status status = compute_struct_layout(ctx, struct_ast);
+            if(status != Status::good)
+            {
+                break;
+            }
+            new_stage = 3;
+        } // fall through
+    }
+    
+    if(new_stage < 3)
+    {
+        auto job = make_typecheck_job(type, struct_ast, new_stage);
+        add_waiting_job(ctx, job);
+    }
+    return new_stage != stage;
+}
+
+internal
+bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST *unop_ast)
+{
+    u32 new_stage = 0;
+    u32 done_stage;
     
     switch(unop_ast->op)
     {
@@ -1260,13 +1937,13 @@ bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST
                 } // fall through
                 case 2: {
                     new_stage = 2;
-                    if(!type_resolved(unop_ast->operand))
+                    if(wait_for(ctx, unop_ast->operand))
                     {
                         goto finish;
                     }
                     // TODO: make sure this is a concrete type, rather than numberlike_t_ast
                     // TODO: make sure it isn't negative an unsigned type
-                    set_resolved_type(unop_ast, unop_ast->operand->resolved_type);
+                    set_resolved_type(ctx, unop_ast, unop_ast->operand->resolved_type);
                     new_stage = 3;
                 } // fall through
             }
@@ -1282,19 +1959,14 @@ bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST
                     if(type)
                     {
                         // TODO: maybe make a canonical type table, so not every & makes a new type in memory
-                        Unary_Operator_AST *type_to_deref = construct_ast(ctx->ast_pool, Unary_Operator_AST, 0, 0);
-                        type_to_deref->flags |= AST_FLAG_SYNTHETIC;
-                        set_resolved_type(type_to_deref, &type_t_ast);
-                        type_to_deref->op = Unary_Operator::ref;
-                        type_to_deref->operand = type;
-                        type_to_check = type_to_deref;
+                        type_to_check = make_pointer_type(ctx, type);
                     }
                     auto job = make_typecheck_job(type_to_check, unop_ast->operand);
                     do_typecheck_job(ctx, job);
                 } // fall through
                 case 1: {
                     new_stage = 1;
-                    if(!type_resolved(unop_ast->operand))
+                    if(wait_for(ctx, unop_ast->operand))
                     {
                         goto finish;
                     }
@@ -1318,7 +1990,7 @@ bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST
                     {
                         goto finish;
                     }
-                    set_resolved_type(unop_ast, operand_type->operand);
+                    set_resolved_type(ctx, unop_ast, operand_type->operand);
                     new_stage = 2;
                 } // fall through
             }
@@ -1369,7 +2041,7 @@ bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST
                 } // fall through
                 case 1: {
                     new_stage = 1;
-                    if(!type_resolved(unop_ast->operand))
+                    if(wait_for(ctx, unop_ast->operand))
                     {
                         goto finish;
                     }
@@ -1393,25 +2065,20 @@ bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST
                     }
                     if(unop_ast->operand->resolved_type == &type_t_ast)
                     {
-                        set_resolved_type(unop_ast, &type_t_ast);
+                        set_resolved_type(ctx, unop_ast, &type_t_ast);
                     }
                     else if(type)
                     {
                         // TODO: check if type matches?
                         // inner_type should match unop_ast->operand->resolved_type
                         // type should be a pointer type
-                        set_resolved_type(unop_ast, type);
+                        set_resolved_type(ctx, unop_ast, type);
                     }
                     else
                     {
                         // TODO: type table to reduce memory usage? (among other things)
-                        Unary_Operator_AST *pointer_type = construct_ast(ctx->ast_pool, Unary_Operator_AST, 0, 0);
-                        pointer_type->flags |= AST_FLAG_SYNTHETIC;
-                        set_resolved_type(pointer_type, &type_t_ast);
-                        pointer_type->op = Unary_Operator::ref;
-                        pointer_type->operand = unop_ast->operand->resolved_type;
-                        
-                        set_resolved_type(unop_ast, pointer_type);
+                        Unary_Operator_AST *pointer_type = make_pointer_type(ctx, unop_ast->operand->resolved_type);
+                        set_resolved_type(ctx, unop_ast, pointer_type);
                     }
                     new_stage = 2;
                 } // fall through
@@ -1441,12 +2108,12 @@ bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST
                 } // fall through
                 case 1: {
                     new_stage = 1;
-                    if(!type_resolved(unop_ast->operand))
+                    if(wait_for(ctx, unop_ast->operand))
                     {
                         goto finish;
                     }
                     // TODO: make sure this is a concrete type (instead of boollike)
-                    set_resolved_type(unop_ast, unop_ast->operand->resolved_type);
+                    set_resolved_type(ctx, unop_ast, unop_ast->operand->resolved_type);
                     new_stage = 2;
                 } // fall through
             }
@@ -1457,7 +2124,7 @@ bool typecheck_unary(Context *ctx, u32 stage, Expr_AST *type, Unary_Operator_AST
     if(new_stage < done_stage)
     {
         auto job = make_typecheck_job(type, unop_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -1469,23 +2136,17 @@ bool typecheck_ident(Context *ctx, u32 stage, Expr_AST *type, Ident_AST *ident_a
     {
         case 0: {
             ident_ast->flags |= EXPR_FLAG_LVALUE;
-            Expr_AST *expr = scope_find(ident_ast->scope, ident_ast->atom, ident_ast->scope_index);
-            if(expr)
-            {
-                ident_set_expr(ident_ast, expr);
-            }
-            else
+            // Note: bound to its definition by create_scope_metadata
+            assert(ident_get_expr(ident_ast));
+            if(ctx->unchecked_decls)
             {
-                String *str = ident_ast->atom.str;
-                print_err("Error: %d:%d: Undeclared identifier \"%.*s\"\n", ident_ast->line_number, ident_ast->line_offset, str->count, str->data);
-                ctx->success = false;
-                break;
+                schedule_referenced_decl(ctx, ident_get_expr(ident_ast));
             }
         } // fall through
         case 1: {
             new_stage = 1;
             Expr_AST *expr = ident_get_expr(ident_ast);
-            if(!type_resolved(expr))
+            if(wait_for(ctx, expr))
             {
                 break;
             }
@@ -1501,7 +2162,7 @@ bool typecheck_ident(Context *ctx, u32 stage, Expr_AST *type, Ident_AST *ident_a
                     break;
                 }
             }
-            set_resolved_type(ident_ast, expr->resolved_type);
+            set_resolved_type(ctx, ident_ast, expr->resolved_type);
             new_stage = 3;
         } // fall through
     }
@@ -1509,7 +2170,7 @@ bool typecheck_ident(Context *ctx, u32 stage, Expr_AST *type, Ident_AST *ident_a
     if(new_stage < 3)
     {
         auto job = make_typecheck_job(type, ident_ast, new_stage);
-        array_add(ctx->waiting_jobs, job);
+        add_waiting_job(ctx, job);
     }
     return new_stage != stage;
 }
@@ -1522,18 +2183,18 @@ bool typecheck_primitive(Context *ctx, Expr_AST *type, Primitive_AST *prim_ast)
         Status status = types_match(ctx, type, &type_t_ast);
         if(status == Status::good)
         {
-            set_resolved_type(prim_ast, &type_t_ast);
+            set_resolved_type(ctx, prim_ast, &type_t_ast);
             return true;
         }
     }
     else
     {
-        set_resolved_type(prim_ast, &type_t_ast);
+        set_resolved_type(ctx, prim_ast, &type_t_ast);
         return true;
     }
     
     auto job = make_typecheck_job(type, prim_ast);
-    array_add(ctx->waiting_jobs, job);
+    add_waiting_job(ctx, job);
     return false;
 }
 
@@ -1577,16 +2238,16 @@ bool typecheck_bool(Context *ctx, Expr_AST *type, Bool_AST *bool_ast)
             {
                 case PRIM_NO_SIZE:
                 case PRIM_SIZE1: {
-                    set_resolved_type(bool_ast, &bool8_t_ast);
+                    set_resolved_type(ctx, bool_ast, &bool8_t_ast);
                 } break;
                 case PRIM_SIZE2: {
-                    set_resolved_type(bool_ast, &bool16_t_ast);
+                    set_resolved_type(ctx, bool_ast, &bool16_t_ast);
                 } break;
                 case PRIM_SIZE4: {
-                    set_resolved_type(bool_ast, &bool32_t_ast);
+                    set_resolved_type(ctx, bool_ast, &bool32_t_ast);
                 } break;
                 case PRIM_SIZE8: {
-                    set_resolved_type(bool_ast, &bool64_t_ast);
+                    set_resolved_type(ctx, bool_ast, &bool64_t_ast);
                 } break;
                 default: {
                     assert(false);
@@ -1597,12 +2258,12 @@ bool typecheck_bool(Context *ctx, Expr_AST *type, Bool_AST *bool_ast)
     }
     else
     {
-        set_resolved_type(bool_ast, &bool8_t_ast);
+        set_resolved_type(ctx, bool_ast, &bool8_t_ast);
         return true;
     }
     
     auto job = make_typecheck_job(type, bool_ast);
-    array_add(ctx->waiting_jobs, job);
+    add_waiting_job(ctx, job);
     return false;
 }
 
@@ -1613,6 +2274,15 @@ Status reduce_type(Context *ctx, Expr_AST *type, Expr_AST **type_out)
     assert(type_resolved(type));
     // assert type->resolved_type matches type_t_ast ?
     
+    // Note: every ident and access along a chain of aliases is cached with the type at its end,
+    // so reducing any of them again is a single lookup
+    Expr_AST *reduced = cached_reduced_type(ctx->type_table, type);
+    if(reduced)
+    {
+        *type_out = reduced;
+        return Status::good;
+    }
+    
     switch(type->type)
     {
         case AST_Type::ident_ast: {
@@ -1626,7 +2296,12 @@ Status reduce_type(Context *ctx, Expr_AST *type, Expr_AST **type_out)
             {
                 if(expr)
                 {
-                    return reduce_type(ctx, expr, type_out);
+                    Status status = reduce_type(ctx, expr, type_out);
+                    if(status == Status::good)
+                    {
+                        cache_reduced_type(ctx->type_table, type, *type_out);
+                    }
+                    return status;
                 }
                 else
                 {
@@ -1645,7 +2320,12 @@ Status reduce_type(Context *ctx, Expr_AST *type, Expr_AST **type_out)
             Access_AST *access_ast = static_cast<Access_AST*>(type);
             if(access_ast->expr)
             {
-                return reduce_type(ctx, access_ast->expr, type_out);
+                Status status = reduce_type(ctx, access_ast->expr, type_out);
+                if(status == Status::good)
+                {
+                    cache_reduced_type(ctx->type_table, type, *type_out);
+                }
+                return status;
             }
             else
             {
@@ -1823,6 +2503,23 @@ Status types_match(Context *ctx, Expr_AST *t1, Expr_AST *t2, bool report)
         return status;
     }
     
+    // Note: equal types always match, and pointer and function types are equal when their
+    // canonical nodes are. The rest are still compared part by part, since a primitive also
+    // matches a smaller one of the same kind, and types that aren't fully resolved have no
+    // canonical node yet
+    if(lhs == rhs)
+    {
+        return Status::good;
+    }
+    if(lhs->type == rhs->type && (lhs->type == AST_Type::unary_ast || lhs->type == AST_Type::function_type_ast))
+    {
+        Expr_AST *canonical_lhs = canonical_type(ctx->type_table, ctx->ast_pool, lhs);
+        if(canonical_lhs && canonical_lhs == canonical_type(ctx->type_table, ctx->ast_pool, rhs))
+        {
+            return Status::good;
+        }
+    }
+    
     switch(lhs->type)
     {
         case AST_Type::function_type_ast: {
@@ -1873,6 +2570,7 @@ Status types_match(Context *ctx, Expr_AST *t1, Expr_AST *t2, bool report)
                     return status;
                 }
             }
+            return Status::good;
         } break;
         case AST_Type::enum_ast: {
             if(lhs != rhs)
@@ -1884,6 +2582,7 @@ Status types_match(Context *ctx, Expr_AST *t1, Expr_AST *t2, bool report)
                 }
                 return Status::bad;
             }
+            return Status::good;
         } break;
         case AST_Type::struct_ast: {
             if(lhs != rhs)
@@ -1895,6 +2594,7 @@ Status types_match(Context *ctx, Expr_AST *t1, Expr_AST *t2, bool report)
                 }
                 return Status::bad;
             }
+            return Status::good;
         } break;
         case AST_Type::unary_ast: {
             if(rhs->type != AST_Type::unary_ast)
@@ -2026,68 +2726,625 @@ void print_jobs(Array<Job> jobs)
 {
     for(u64 i = 0; i < jobs.count; ++i)
     {
-        Job *job = &jobs[i];
-        AST *ast = job->typecheck.ast;
-        print_err("Waiting job %lu:\n\tStage: %lu\n\tLocation: %lu:%lu\n\tAST_Type: %s\n", i, job->stage, ast->line_number, ast->line_offset, ast_type_names[(u64)ast->type]);
+        AST *ast = job_ast(jobs[i]);
+        print_err("Waiting job %lu:\n\tStage: %lu\n\tLocation: %lu:%lu\n\tAST_Type: %s\n", i, (u64)job_stage(jobs[i]), ast->line_number, ast->line_offset, ast_type_names[(u64)ast->type]);
+    }
+}
+
+// Note: synthetic ASTs share a location, so ties are broken by serial
+internal
+int compare_job_locations(const void *a, const void *b)
+{
+    AST *ast_a = job_ast(static_cast<const Stalled_Job*>(a)->job);
+    AST *ast_b = job_ast(static_cast<const Stalled_Job*>(b)->job);
+    if(ast_a->line_number != ast_b->line_number)
+    {
+        return (ast_a->line_number < ast_b->line_number) ? -1 : 1;
+    }
+    if(ast_a->line_offset != ast_b->line_offset)
+    {
+        return (ast_a->line_offset < ast_b->line_offset) ? -1 : 1;
+    }
+    if(ast_a->s != ast_b->s)
+    {
+        return (ast_a->s < ast_b->s) ? -1 : 1;
+    }
+    return 0;
+}
+
+constexpr u64 NO_STALLED_JOB = (u64)-1;
+// Note: a long cycle is usually one mistake repeated, so only its start is printed
+constexpr u64 MAX_PRINTED_CYCLE_JOBS = 16;
+
+// Note: a node, and the stalled job that would resolve it
+struct Node_Owner
+{
+    u64 s;
+    u64 job;
+};
+
+internal
+int compare_node_owners(const void *a, const void *b)
+{
+    u64 s_a = static_cast<const Node_Owner*>(a)->s;
+    u64 s_b = static_cast<const Node_Owner*>(b)->s;
+    return (s_a < s_b) ? -1 : (s_a > s_b) ? 1 : 0;
+}
+
+// Note: the owners are sorted by serial
+internal
+u64 find_node_owner(Array<Node_Owner> owners, Expr_AST *node)
+{
+    u64 begin = 0;
+    u64 end = owners.count;
+    while(begin < end)
+    {
+        u64 middle = begin + (end - begin) / 2;
+        if(owners[middle].s < node->s)
+        {
+            begin = middle + 1;
+        }
+        else
+        {
+            end = middle;
+        }
+    }
+    if(begin < owners.count && owners[begin].s == node->s)
+    {
+        return owners[begin].job;
+    }
+    return NO_STALLED_JOB;
+}
+
+// Note: besides its own AST, a decl job resolves the declared ident, and a function job resolves
+// its parameters
+internal
+void add_node_owners(Dynamic_Array<Node_Owner> *owners, Job job, u64 index)
+{
+    AST *ast = job_ast(job);
+    Node_Owner owner = {ast->s, index};
+    array_add(owners, owner);
+    if(ast->type == AST_Type::decl_ast)
+    {
+        Node_Owner ident_owner = {static_cast<Decl_AST*>(ast)->ident.s, index};
+        array_add(owners, ident_owner);
+    }
+    else if(ast->type == AST_Type::function_ast)
+    {
+        Array<Ident_AST*> param_names = static_cast<Function_AST*>(ast)->param_names;
+        for(u64 i = 0; i < param_names.count; ++i)
+        {
+            if(param_names[i])
+            {
+                Node_Owner param_owner = {param_names[i]->s, index};
+                array_add(owners, param_owner);
+            }
+        }
+    }
+}
+
+// Note: the node a retried job waits for. Only a struct waiting for the layout of a field's type
+// is known, since it yields without parking
+internal
+Expr_AST *find_blocking_node(Type_Table *tt, Job job)
+{
+    if(job_ast(job)->type != AST_Type::struct_ast)
+    {
+        return nullptr;
+    }
+    Struct_AST *struct_ast = static_cast<Struct_AST*>(job_ast(job));
+    for(u64 i = 0; i < struct_ast->fields.count; ++i)
+    {
+        Ident_AST *field = &struct_ast->fields[i]->ident;
+        if(!type_resolved(field))
+        {
+            return field;
+        }
+        Expr_AST *field_type = field->resolved_type;
+        Expr_AST *reduced = cached_reduced_type(tt, field_type);
+        if(reduced)
+        {
+            field_type = reduced;
+        }
+        if(field_type->type == AST_Type::struct_ast &&
+           !__atomic_load_n(&static_cast<Struct_AST*>(field_type)->layout.alignment, __ATOMIC_ACQUIRE))
+        {
+            return field_type;
+        }
+    }
+    return nullptr;
+}
+
+// Note: the strongly connected components of the wait-for graph, by Tarjan's algorithm. Each job
+// waits for at most one node, so each has at most one edge, and the search keeps its own stack
+// instead of recursing, since a chain of waiting jobs can be long
+internal
+u64 find_wait_components(Array<u64> waits_for, u64 *components)
+{
+    u64 count = waits_for.count;
+    u64 *indices = mem_alloc(u64, count);
+    u64 *low_links = mem_alloc(u64, count);
+    bool *on_stack = mem_alloc(bool, count);
+    u64 *stack = mem_alloc(u64, count);
+    u64 *path = mem_alloc(u64, count);
+    defer {
+        mem_dealloc(indices, count);
+        mem_dealloc(low_links, count);
+        mem_dealloc(on_stack, count);
+        mem_dealloc(stack, count);
+        mem_dealloc(path, count);
+    };
+    
+    for(u64 i = 0; i < count; ++i)
+    {
+        indices[i] = NO_STALLED_JOB;
+        on_stack[i] = false;
     }
+    
+    u64 next_index = 0;
+    u64 stack_count = 0;
+    u64 component_count = 0;
+    for(u64 root = 0; root < count; ++root)
+    {
+        if(indices[root] != NO_STALLED_JOB)
+        {
+            continue;
+        }
+        
+        // Note: follows the edges until they lead out of the graph, or to a job seen before
+        u64 path_count = 0;
+        u64 job = root;
+        while(job != NO_STALLED_JOB && indices[job] == NO_STALLED_JOB)
+        {
+            indices[job] = next_index;
+            low_links[job] = next_index;
+            ++next_index;
+            stack[stack_count++] = job;
+            on_stack[job] = true;
+            path[path_count++] = job;
+            job = waits_for[job];
+        }
+        if(job != NO_STALLED_JOB && on_stack[job])
+        {
+            u64 last = path[path_count - 1];
+            if(indices[job] < low_links[last])
+            {
+                low_links[last] = indices[job];
+            }
+        }
+        
+        // Note: then returns along the path, as the recursive version would
+        while(path_count > 0)
+        {
+            job = path[--path_count];
+            if(path_count > 0)
+            {
+                u64 caller = path[path_count - 1];
+                if(low_links[job] < low_links[caller])
+                {
+                    low_links[caller] = low_links[job];
+                }
+            }
+            if(low_links[job] == indices[job])
+            {
+                u64 member;
+                do
+                {
+                    member = stack[--stack_count];
+                    on_stack[member] = false;
+                    components[member] = component_count;
+                } while(member != job);
+                ++component_count;
+            }
+        }
+    }
+    return component_count;
 }
 
-bool typecheck_all(Pool_Allocator *ast_pool, Array<Decl_AST*> decls)
+internal
+void print_stalled_job(Stalled_Job *stalled, Expr_AST *blocker)
 {
-    Dynamic_Array<Job> job_arrays[2] = {0};
-    auto current = &job_arrays[0];
-    auto next = &job_arrays[1];
+    AST *ast = job_ast(stalled->job);
+    print_err("\t%s at %lu:%lu (stage %lu)", ast_type_names[(u64)ast->type], ast->line_number, ast->line_offset, (u64)job_stage(stalled->job));
+    if(blocker)
+    {
+        print_err(" waits for %s at %lu:%lu\n", ast_type_names[(u64)blocker->type], blocker->line_number, blocker->line_offset);
+    }
+    else
+    {
+        print_err(" yielded without waiting for a node\n");
+    }
+}
+
+void report_stalled_jobs(Type_Table *tt, Dynamic_Array<Stalled_Job> *stalled)
+{
+    qsort(stalled->data, stalled->count, sizeof(Stalled_Job), compare_job_locations);
+    
+    u64 count = stalled->count;
+    Dynamic_Array<Node_Owner> owners = {0};
+    Expr_AST **blockers = mem_alloc(Expr_AST*, count);
+    Dynamic_Array<u64> waits_for = {0};
+    array_resize(&waits_for, count);
+    waits_for.count = count;
+    u64 *components = mem_alloc(u64, count);
+    defer {
+        array_free(&owners);
+        mem_dealloc(blockers, count);
+        array_free(&waits_for);
+        mem_dealloc(components, count);
+    };
+    
+    for(u64 i = 0; i < count; ++i)
+    {
+        add_node_owners(&owners, (*stalled)[i].job, i);
+    }
+    qsort(owners.data, owners.count, sizeof(Node_Owner), compare_node_owners);
+    for(u64 i = 0; i < count; ++i)
+    {
+        Stalled_Job *job = &(*stalled)[i];
+        blockers[i] = job->node ? job->node : find_blocking_node(tt, job->job);
+        waits_for[i] = blockers[i] ? find_node_owner(owners.array, blockers[i]) : NO_STALLED_JOB;
+    }
+    
+    u64 component_count = find_wait_components(waits_for.array, components);
     
+    // Note: only the components that wait for no other are reported, the rest wait on them
+    u64 *first_jobs = mem_alloc(u64, component_count);
+    u64 *sizes = mem_alloc(u64, component_count);
+    bool *waiting = mem_alloc(bool, component_count);
+    defer {
+        mem_dealloc(first_jobs, component_count);
+        mem_dealloc(sizes, component_count);
+        mem_dealloc(waiting, component_count);
+    };
+    for(u64 c = 0; c < component_count; ++c)
+    {
+        first_jobs[c] = NO_STALLED_JOB;
+        sizes[c] = 0;
+        waiting[c] = false;
+    }
+    for(u64 i = 0; i < count; ++i)
+    {
+        u64 c = components[i];
+        if(first_jobs[c] == NO_STALLED_JOB)
+        {
+            first_jobs[c] = i;
+        }
+        ++sizes[c];
+        if(waits_for[i] != NO_STALLED_JOB && components[waits_for[i]] != c)
+        {
+            waiting[c] = true;
+        }
+    }
+    
+    print_err("Error: no progress (%lu waiting jobs)\n", count);
+    u64 reported_count = 0;
+    for(u64 i = 0; i < count; ++i)
+    {
+        u64 c = components[i];
+        if(first_jobs[c] != i || waiting[c])
+        {
+            continue;
+        }
+        AST *ast = job_ast((*stalled)[i].job);
+        if(sizes[c] == 1 && waits_for[i] == i)
+        {
+            print_err("Error: %lu:%lu: Circular dependency on itself\n", ast->line_number, ast->line_offset);
+            print_stalled_job(&(*stalled)[i], blockers[i]);
+        }
+        else if(sizes[c] > 1)
+        {
+            print_err("Error: %lu:%lu: Circular dependency between %lu jobs\n", ast->line_number, ast->line_offset, sizes[c]);
+            u64 job = i;
+            u64 print_count = (sizes[c] > MAX_PRINTED_CYCLE_JOBS) ? MAX_PRINTED_CYCLE_JOBS : sizes[c];
+            for(u64 j = 0; j < print_count; ++j)
+            {
+                print_stalled_job(&(*stalled)[job], blockers[job]);
+                job = waits_for[job];
+            }
+            if(print_count < sizes[c])
+            {
+                print_err("\t... and %lu more\n", sizes[c] - print_count);
+            }
+        }
+        else
+        {
+            print_err("Error: %lu:%lu: Cannot make progress\n", ast->line_number, ast->line_offset);
+            print_stalled_job(&(*stalled)[i], blockers[i]);
+        }
+        reported_count += sizes[c];
+    }
+    if(reported_count < count)
+    {
+        print_err("%lu other jobs wait for these\n", count - reported_count);
+    }
+}
+
+// Note: adds every job that is still parked or retried, so all of them can be reported
+internal
+void add_stalled_jobs(Context *ctx, Dynamic_Array<Stalled_Job> *stalled)
+{
+    Job waiting;
+    while(pop_job_front(ctx->waiting_jobs, &waiting))
+    {
+        Stalled_Job job = {waiting, nullptr};
+        array_add(stalled, job);
+    }
+    // Note: a parked job is woken when its node is resolved, so the rest are still parked
+    for(u64 i = 0; i < ctx->parked_jobs.count; ++i)
+    {
+        Parked_Job *parked = &ctx->parked_jobs[i];
+        if(!type_resolved(parked->node))
+        {
+            Stalled_Job job = {parked->job, parked->node};
+            array_add(stalled, job);
+        }
+    }
+}
+
+// Note: puts every declaration in the table, then takes out the entry points, which are the
+// ones to seed
+internal
+bool select_entry_points(Atom_Table *atom_table, Array<Decl_AST*> decls, Array<String> names, Dynamic_Array<Decl_AST*> *seeds, Unchecked_Decls *unchecked)
+{
+    unchecked->count = next_serial;
+    unchecked->decls = mem_alloc(Decl_AST*, unchecked->count);
+    zero_memory(unchecked->decls, unchecked->count);
+    for(u64 i = 0; i < decls.count; ++i)
+    {
+        unchecked->decls[decls[i]->ident.s] = decls[i];
+    }
+    
+    for(u64 i = 0; i < names.count; ++i)
+    {
+        Atom atom = atomize_string(atom_table, names[i]);
+        bool found = false;
+        for(u64 j = 0; j < decls.count; ++j)
+        {
+            if(decls[j]->ident.atom == atom)
+            {
+                unchecked->decls[decls[j]->ident.s] = nullptr;
+                found = true;
+            }
+        }
+        if(!found)
+        {
+            print_err("Error: entry point \"%.*s\" is not declared\n", (int)names[i].count, names[i].data);
+            return false;
+        }
+    }
+    
+    for(u64 i = 0; i < decls.count; ++i)
+    {
+        if(!unchecked->decls[decls[i]->ident.s])
+        {
+            array_add(seeds, decls[i]);
+        }
+    }
+    return true;
+}
+
+bool typecheck_all(Pool_Allocator *ast_pool, Atom_Table *atom_table, Array<Decl_AST*> decls, u64 thread_count, Typecheck_Stats *stats, Array<String> entry_points)
+{
+    Dynamic_Array<Decl_AST*> seeds = {0};
+    Unchecked_Decls unchecked = {0};
+    Unchecked_Decls *unchecked_decls = nullptr;
+    defer {
+        array_free(&seeds);
+        if(unchecked.decls)
+        {
+            mem_dealloc(unchecked.decls, unchecked.count);
+        }
+    };
+    if(entry_points.count)
+    {
+        if(!select_entry_points(atom_table, decls, entry_points, &seeds, &unchecked))
+        {
+            return false;
+        }
+        decls = seeds.array;
+        unchecked_decls = &unchecked;
+    }
+    
+    if(thread_count > 1)
+    {
+        return typecheck_all_parallel(ast_pool, atom_table, decls, thread_count, stats, unchecked_decls);
+    }
+    
+    // Note: the queues share their chunks, since the retried jobs move to the ready ones each round
+    Job_Chunk_Pool job_chunks;
+    init_job_chunk_pool(&job_chunks);
+    Job_Queue job_queues[2];
+    Job_Queue deferred_bodies;
+    init_job_queue(&job_queues[0], &job_chunks);
+    init_job_queue(&job_queues[1], &job_chunks);
+    init_job_queue(&deferred_bodies, &job_chunks);
+    Type_Table type_table;
+    init_type_table(&type_table, next_serial);
     Context ctx;
+    zero_struct(&ctx);
+    // Note: the diagnostics are printed sorted by location, like on several threads, so the output
+    // does not depend on the thread count
+    Dynamic_Array<Diagnostic> diagnostics = {0};
+    diagnostic_buffer = &diagnostics;
+    defer {
+        free_job_chunk_pool(&job_chunks);
+        array_free(&ctx.parked_jobs);
+        array_free(&ctx.wait_lists);
+        free_type_table(&type_table);
+        diagnostic_buffer = nullptr;
+        for(u64 i = 0; i < diagnostics.count; ++i)
+        {
+            mem_dealloc(diagnostics[i].text.data, diagnostics[i].text.count);
+        }
+        array_free(&diagnostics);
+    };
+    
     ctx.ast_pool = ast_pool;
-    ctx.waiting_jobs = next;
+    ctx.atom_table = atom_table;
+    ctx.type_table = &type_table;
+    ctx.ready_jobs = &job_queues[0];
+    ctx.waiting_jobs = &job_queues[1];
+    ctx.unchecked_decls = unchecked_decls;
+    ctx.stats = stats;
     ctx.success = true;
     
+    // Note: seeding the declarations counts as the first round
+    if(stats)
+    {
+        ++stats->round_count;
+    }
+    // Note: the signatures are checked first, then the function bodies
+    ctx.deferred_bodies = &deferred_bodies;
     for(u64 i = 0; i < decls.count; ++i)
     {
         auto job = make_typecheck_job(nullptr, decls[i]);
         do_typecheck_job(&ctx, job);
     }
+    ctx.deferred_bodies = nullptr;
+    Job job;
+    while(pop_job_front(&deferred_bodies, &job))
+    {
+        do_typecheck_job(&ctx, job);
+    }
+    
+    // Note: like on several threads, the rounds go on after a job fails, until nothing changes, so
+    // every diagnostic that can be found is reported
+    // A job that made no progress changed nothing, so once every job that is not parked has
+    // been run since the last progress, running them again would not help either. This stops
+    // there, rather than after a whole round without progress
+    u64 runs_since_progress = 0;
+    bool stalled = false;
+    while(!stalled)
+    {
+        // Note: the ready jobs are those woken since the last round, then the retried jobs
+        Job_Queue *ready = ctx.ready_jobs;
+        Job_Queue *retry = ctx.waiting_jobs;
+        append_job_queue(ready, retry);
+        
+        if(ready->count == 0)
+        {
+            stalled = (ctx.parked_count != 0);
+            break;
+        }
+        
+        if(stats)
+        {
+            ++stats->round_count;
+        }
+        while(pop_job_front(ready, &job))
+        {
+            if(do_typecheck_job(&ctx, job))
+            {
+                runs_since_progress = 0;
+            }
+            else if(++runs_since_progress >= ready->count + retry->count)
+            {
+                // Note: the jobs that were not run again are still waiting
+                append_job_queue(retry, ready);
+                stalled = true;
+                break;
+            }
+        }
+    }
     
+    diagnostic_buffer = nullptr;
+    print_diagnostics(diagnostics.array);
     if(!ctx.success)
     {
-        print_err("Success flag was unset (1)\n");
+        print_err("Success flag was unset\n");
         return false;
     }
+    if(!stalled)
+    {
+        return true;
+    }
+    
+    Dynamic_Array<Stalled_Job> stalled_jobs = {0};
+    add_stalled_jobs(&ctx, &stalled_jobs);
+    report_stalled_jobs(&type_table, &stalled_jobs);
+    array_free(&stalled_jobs);
+    return false;
+}
+
+void add_typecheck_stats(Typecheck_Stats *total, Typecheck_Stats *stats)
+{
+    total->round_count += stats->round_count;
+    for(u64 type = 0; type < AST_TYPE_COUNT; ++type)
+    {
+        for(u64 stage = 0; stage < TYPECHECK_STAGE_COUNT; ++stage)
+        {
+            total->job_counts[type][stage] += stats->job_counts[type][stage];
+        }
+        total->parked_counts[type] += stats->parked_counts[type];
+        total->retried_counts[type] += stats->retried_counts[type];
+        total->cycles[type] += stats->cycles[type];
+    }
+}
+
+internal
+u64 count_jobs(Typecheck_Stats *stats, u64 type)
+{
+    u64 count = 0;
+    for(u64 stage = 0; stage < TYPECHECK_STAGE_COUNT; ++stage)
+    {
+        count += stats->job_counts[type][stage];
+    }
+    return count;
+}
+
+void print_typecheck_stats(Typecheck_Stats *stats)
+{
+    u64 job_count = 0;
+    u64 parked_count = 0;
+    u64 retried_count = 0;
+    u64 cycles = 0;
+    for(u64 type = 0; type < AST_TYPE_COUNT; ++type)
+    {
+        job_count += count_jobs(stats, type);
+        parked_count += stats->parked_counts[type];
+        retried_count += stats->retried_counts[type];
+        cycles += stats->cycles[type];
+    }
     
-    while(true)
+    print_err("Typechecking: %lu rounds, %lu jobs, %lu parked, %lu retried, %.2f Mcycles\n", stats->round_count, job_count, parked_count, retried_count, cycles / 1000000.0);
+    print_err("  %-16s %9s %9s %9s %12s %10s %6s  %s\n", "type", "jobs", "parked", "retried", "cycles", "cycles/job", "share", "jobs by stage");
+    for(u64 type = 0; type < AST_TYPE_COUNT; ++type)
     {
-        auto tmp = current;
-        current = next;
-        next = tmp;
-        
-        if(current->count == 0)
+        u64 count = count_jobs(stats, type);
+        if(!count)
         {
-            return true;
+            continue;
         }
-        next->count = 0;
-        ctx.waiting_jobs = next;
-        
-        bool change = false;
-        for(u64 i = 0; i < current->count; ++i)
+        print_err("  %-16s %9lu %9lu %9lu %12lu %10.1f %5.1f%% ", ast_type_names[type], count, stats->parked_counts[type], stats->retried_counts[type], stats->cycles[type], (double)stats->cycles[type] / count, cycles ? 100.0 * stats->cycles[type] / cycles : 0.0);
+        for(u64 stage = 0; stage < TYPECHECK_STAGE_COUNT; ++stage)
         {
-            if(do_typecheck_job(&ctx, (*current)[i]))
+            if(stats->job_counts[type][stage])
             {
-                change = true;
+                print_err(" %lu:%lu", stage, stats->job_counts[type][stage]);
             }
         }
-        
-        if(!ctx.success)
+        print_err("\n");
+    }
+}
+
+void print_typecheck_stats_json(Typecheck_Stats *stats)
+{
+    print("{\"rounds\": %lu, \"types\": [", stats->round_count);
+    bool first = true;
+    for(u64 type = 0; type < AST_TYPE_COUNT; ++type)
+    {
+        if(!count_jobs(stats, type))
         {
-            print_err("Success flag was unset (2)\n");
-            return false;
+            continue;
         }
-        else if(!change)
+        print("%s\n  {\"type\": \"%s\", \"parked\": %lu, \"retried\": %lu, \"cycles\": %lu, \"jobs_by_stage\": [", first ? "" : ",", ast_type_names[type], stats->parked_counts[type], stats->retried_counts[type], stats->cycles[type]);
+        for(u64 stage = 0; stage < TYPECHECK_STAGE_COUNT; ++stage)
         {
-            // TODO: detect error
-            print_err("Error: no progress (%lu waiting jobs)\n", next->count);
-            print_jobs(next->array);
-            return false;
+            print("%s%lu", stage ? ", " : "", stats->job_counts[type][stage]);
         }
+        print("]}");
+        first = false;
     }
+    print("\n]}\n");
 }
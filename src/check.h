@@ -3,32 +3,106 @@
 
 #include "ast.h"
 #include "basic.h"
+#include "job_queue.h"
 #include "pool_allocator.h"
 
-enum class Job_Type : u32
+// Note: a job waiting for a node to be resolved, the jobs parked on one node are chained through
+// next in the order they were parked
+struct Parked_Job
 {
-    typecheck,
+    Job job;
+    Expr_AST *node;
+    u32 next;
 };
 
-struct Job
+constexpr u32 NO_PARKED_JOB = (u32)-1;
+
+struct Wait_List
+{
+    u32 first;
+    u32 last;
+};
+
+// Note: a job left over when typechecking stops making progress, node is the one it is parked on,
+// or null if it was going to be retried
+struct Stalled_Job
+{
+    Job job;
+    Expr_AST *node;
+};
+
+struct Type_Table;
+struct Typecheck_Worker;
+
+// Note: indexed by the serial of a declared ident, the top-level declarations that are only
+// typechecked once an identifier that refers to them is. The job that schedules one takes it out
+struct Unchecked_Decls
 {
-    Job_Type type;
-    u32 stage;
-    union {
-        struct {
-            Expr_AST *type;
-            AST *ast;
-        } typecheck;
-    };
+    Decl_AST **decls;
+    u64 count;
+};
+
+constexpr u64 AST_TYPE_COUNT = (u64)AST_Type::bool_ast + 1;
+// Note: no job has more stages than this, a later stage would be counted with the last
+constexpr u64 TYPECHECK_STAGE_COUNT = 5;
+
+// Note: collected while Context::stats is set. The cycles of a job do not include those of the
+// jobs it runs directly
+struct Typecheck_Stats
+{
+    u64 round_count;
+    // Note: indexed by AST_Type and the stage the job was run from
+    u64 job_counts[AST_TYPE_COUNT][TYPECHECK_STAGE_COUNT];
+    u64 parked_counts[AST_TYPE_COUNT];
+    u64 retried_counts[AST_TYPE_COUNT];
+    u64 cycles[AST_TYPE_COUNT];
 };
 
 struct Context
 {
     Pool_Allocator *ast_pool;
-    Dynamic_Array<Job> *waiting_jobs;
+    Atom_Table *atom_table;
+    // Note: shared by all threads
+    Type_Table *type_table;
+    // Note: jobs woken by set_resolved_type are added while this is being run
+    Job_Queue *ready_jobs;
+    // Note: jobs that yielded without waiting on a particular node, these are retried every round
+    Job_Queue *waiting_jobs;
+    // Note: only set while the declarations are seeded, then function jobs add themselves here
+    // instead of checking their bodies
+    Job_Queue *deferred_bodies;
+    Dynamic_Array<Parked_Job> parked_jobs;
+    // Note: indexed by AST serial, only the entries of nodes with EXPR_FLAG_HAS_WAITERS are set
+    Dynamic_Array<Wait_List> wait_lists;
+    u64 parked_count;
+    // Note: set by wait_for, the node the yielding job waits on
+    Expr_AST *waiting_on;
+    // Note: only set when typechecking on several threads, then jobs are parked and woken through
+    // the worker, and ready_jobs, parked_jobs and wait_lists are not used
+    Typecheck_Worker *worker;
+    // Note: only set when typechecking from entry points
+    Unchecked_Decls *unchecked_decls;
+    // Note: null unless the typechecker is being profiled
+    Typecheck_Stats *stats;
+    // Note: the cycles spent in the jobs run by the one being profiled
+    u64 child_cycles;
     bool success;
 };
 
+// Note: while a thread has a diagnostic buffer, report_error adds to it instead of printing,
+// so that diagnostics from several threads can be printed in a deterministic order
+struct Diagnostic
+{
+    u32 line_number;
+    u32 line_offset;
+    String text;
+};
+
+extern thread_local Dynamic_Array<Diagnostic> *diagnostic_buffer;
+
+// Note: sorts by location, and drops repeats of the same diagnostic
+void print_diagnostics(Array<Diagnostic> diagnostics);
+
 enum class Status
 {
     good,
@@ -36,7 +110,8 @@ enum class Status
     bad,
 };
 
-void set_resolved_type(Expr_AST *expr, Expr_AST *type);
+// Note: wakes the jobs parked on expr. ctx may only be null if nothing can wait on expr yet
+void set_resolved_type(Context *ctx, Expr_AST *expr, Expr_AST *type);
 bool type_resolved(Expr_AST *expr);
 
 Status types_match(Context *ctx, Expr_AST *t1, Expr_AST *t2, bool report = true);
@@ -47,10 +122,23 @@ Job make_typecheck_job(Expr_AST *type, AST *ast, u32 stage = 0);
 
 // Job execution functions return true if there was progress made
 
-bool do_job(Context *ctx, Job job);
 bool do_typecheck_job(Context *ctx, Job job);
 
-bool typecheck_all(Pool_Allocator *ast_pool, Array<Decl_AST*> decls);
+// Note: the diagnostics are printed sorted by location, after typechecking has gone as far as it can,
+// so they do not depend on the thread count
+// If stats is set, the rounds, jobs and cycles are added to it
+// If there are entry points, only the declarations with those names, and the ones they refer to,
+// directly or not, are typechecked. The rest are left unresolved
+bool typecheck_all(Pool_Allocator *ast_pool, Atom_Table *atom_table, Array<Decl_AST*> decls, u64 thread_count = 1, Typecheck_Stats *stats = nullptr, Array<String> entry_points = {});
+
+// Note: sorts the jobs by location, and reports the cycles among them, and the jobs that wait for
+// nothing else that is stalled. The jobs that only wait for those are counted, but not listed
+void report_stalled_jobs(Type_Table *tt, Dynamic_Array<Stalled_Job> *stalled);
+
+void add_typecheck_stats(Typecheck_Stats *total, Typecheck_Stats *stats);
+// Note: the table is printed to stderr, the JSON to stdout, so that it can be piped to other tools
+void print_typecheck_stats(Typecheck_Stats *stats);
+void print_typecheck_stats_json(Typecheck_Stats *stats);
 
 
 #endif // CHECK_H
\ No newline at end of file
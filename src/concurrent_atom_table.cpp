@@ -0,0 +1,107 @@
+
+void init_concurrent_atom_table(Concurrent_Atom_Table *at, u64 initial_shard_size)
+{
+    for(u64 i = 0; i < ATOM_SHARD_COUNT; ++i)
+    {
+        Atom_Shard *shard = &at->shards[i];
+        pthread_mutex_init(&shard->lock, nullptr);
+        init_hash_set(&shard->atom_set, initial_shard_size);
+    }
+    at->next_id = 0;
+    zero_memory(at->string_chunks, ATOM_MAX_CHUNKS);
+}
+
+internal inline
+u64 atom_chunk_size(u64 chunk)
+{
+    return ATOM_CHUNK_BASE << chunk;
+}
+
+void free_concurrent_atom_table(Concurrent_Atom_Table *at)
+{
+    for(u64 i = 0; i < ATOM_SHARD_COUNT; ++i)
+    {
+        Atom_Shard *shard = &at->shards[i];
+        pthread_mutex_destroy(&shard->lock);
+        free_hash_set(&shard->atom_set);
+    }
+    for(u64 i = 0; i < ATOM_MAX_CHUNKS; ++i)
+    {
+        if(at->string_chunks[i])
+        {
+            mem_dealloc(at->string_chunks[i], atom_chunk_size(i));
+            at->string_chunks[i] = nullptr;
+        }
+    }
+    at->next_id = 0;
+}
+
+// Note: chunk i starts at id ATOM_CHUNK_BASE * (2^i - 1)
+internal inline
+String *atom_string_slot(Concurrent_Atom_Table *at, u32 id, bool allocate)
+{
+    u64 n = (u64)id / ATOM_CHUNK_BASE + 1;
+    u64 chunk = 63 - __builtin_clzll(n);
+    u64 offset = (u64)id - ATOM_CHUNK_BASE * ((1UL << chunk) - 1);
+    assert(chunk < ATOM_MAX_CHUNKS);
+    
+    String *strings = __atomic_load_n(&at->string_chunks[chunk], __ATOMIC_ACQUIRE);
+    if(!strings && allocate)
+    {
+        // Note: several threads may race to allocate the chunk, the first one to publish it wins
+        String *new_strings = mem_alloc(String, atom_chunk_size(chunk));
+        assert(new_strings);
+        if(__atomic_compare_exchange_n(&at->string_chunks[chunk], &strings, new_strings, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            strings = new_strings;
+        }
+        else
+        {
+            mem_dealloc(new_strings, atom_chunk_size(chunk));
+        }
+    }
+    assert(strings);
+    return &strings[offset];
+}
+
+Atom atomize_string(Concurrent_Atom_Table *at, Pool_Allocator *string_pool, String str)
+{
+    u64 hash = hash_string(str);
+    Atom_Shard *shard = &at->shards[hash >> (64 - ATOM_SHARD_BITS)];
+    
+    pthread_mutex_lock(&shard->lock);
+    defer {
+        pthread_mutex_unlock(&shard->lock);
+    };
+    
+    u64 slot = set_find_slot(&shard->atom_set, str, hash);
+    if(set_slot_empty(&shard->atom_set, slot))
+    {
+        Atom_Entry entry;
+        entry.str.count = str.count;
+        entry.str.data = pool_alloc(byte, str.count, string_pool);
+        copy_memory(entry.str.data, str.data, str.count);
+        entry.atom.id = __atomic_fetch_add(&at->next_id, 1, __ATOMIC_RELAXED);
+        assert(entry.atom.id < (u32)-1);
+        
+        // Note: published by the shard unlock, or by whatever the caller uses to hand out the atom
+        *atom_string_slot(at, entry.atom.id, true) = entry.str;
+        set_insert_into_slot(&shard->atom_set, slot, hash, entry);
+        
+        return entry.atom;
+    }
+    else
+    {
+        return set_slot_entry(&shard->atom_set, slot)->atom;
+    }
+}
+
+String atom_string(Concurrent_Atom_Table *at, Atom atom)
+{
+    return *atom_string_slot(at, atom.id, false);
+}
+
+u64 atom_count(Concurrent_Atom_Table *at)
+{
+    return __atomic_load_n(&at->next_id, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,46 @@
+#ifndef CONCURRENT_ATOM_TABLE_H
+#define CONCURRENT_ATOM_TABLE_H
+
+#include "basic.h"
+#include "pool_allocator.h"
+#include "scope.h"
+#include <pthread.h>
+
+// Note: an Atom_Table that can be used from several threads at once
+// Strings are sharded on the high bits of their hash, each shard is a Hash_Set behind its own
+// lock. Ids come from one atomic counter, so they stay dense, and identical strings get the
+// same Atom no matter which thread interns them first.
+// The characters of a new atom are copied into the pool passed by the interning thread, so
+// each thread should pass its own pool, and keep it alive as long as the table is used.
+constexpr u64 ATOM_SHARD_BITS = 6;
+constexpr u64 ATOM_SHARD_COUNT = 1 << ATOM_SHARD_BITS;
+
+// Note: the id -> string table grows in chunks that are never moved, chunk i holds
+// ATOM_CHUNK_BASE << i strings
+constexpr u64 ATOM_CHUNK_BASE = 1024;
+constexpr u64 ATOM_MAX_CHUNKS = 23;
+
+// Note: padded, so that threads working on different shards don't share cache lines
+struct alignas(64) Atom_Shard
+{
+    pthread_mutex_t lock;
+    Hash_Set<Atom_Entry,String,get_str,hash_string,operator==> atom_set;
+};
+
+struct Concurrent_Atom_Table
+{
+    Atom_Shard shards[ATOM_SHARD_COUNT];
+    u32 next_id;
+    String *string_chunks[ATOM_MAX_CHUNKS];
+};
+
+void init_concurrent_atom_table(Concurrent_Atom_Table *at, u64 initial_shard_size = 16);
+// Note: not thread-safe, no other thread may use the table
+void free_concurrent_atom_table(Concurrent_Atom_Table *at);
+
+Atom atomize_string(Concurrent_Atom_Table *at, Pool_Allocator *string_pool, String str);
+// Note: atom must come from this table, on this thread or published to it by another thread
+String atom_string(Concurrent_Atom_Table *at, Atom atom);
+u64 atom_count(Concurrent_Atom_Table *at);
+
+#endif // CONCURRENT_ATOM_TABLE_H
@@ -0,0 +1,396 @@
+
+// Note: moves a declaration that is kept from one compilation to the next to where it is in the
+// new version. Only the nodes parsed for it are moved, those it points to from elsewhere, like the
+// inferred types of parameters, are skipped by their serial
+internal
+void move_lines(AST *ast, s64 delta, u32 first_serial, u32 last_serial)
+{
+    if(!ast || ast->s < first_serial || ast->s > last_serial)
+    {
+        return;
+    }
+    ast->line_number = (u32)(ast->line_number + delta);
+    switch(ast->type)
+    {
+        case AST_Type::decl_ast: {
+            Decl_AST *decl_ast = static_cast<Decl_AST*>(ast);
+            move_lines(&decl_ast->ident, delta, first_serial, last_serial);
+            move_lines(decl_ast->decl_type, delta, first_serial, last_serial);
+            move_lines(decl_ast->expr, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::block_ast: {
+            Block_AST *block_ast = static_cast<Block_AST*>(ast);
+            for(u64 i = 0; i < block_ast->statements.count; ++i)
+            {
+                move_lines(block_ast->statements[i], delta, first_serial, last_serial);
+            }
+        } break;
+        case AST_Type::while_ast: {
+            While_AST *while_ast = static_cast<While_AST*>(ast);
+            move_lines(while_ast->guard, delta, first_serial, last_serial);
+            move_lines(while_ast->body, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::for_ast: {
+            For_AST *for_ast = static_cast<For_AST*>(ast);
+            move_lines(for_ast->induction_var, delta, first_serial, last_serial);
+            if(for_ast->flags & FOR_FLAG_OVER_ARRAY)
+            {
+                move_lines(for_ast->index_var, delta, first_serial, last_serial);
+                move_lines(for_ast->array_expr, delta, first_serial, last_serial);
+            }
+            else
+            {
+                move_lines(for_ast->low_expr, delta, first_serial, last_serial);
+                move_lines(for_ast->high_expr, delta, first_serial, last_serial);
+            }
+            move_lines(for_ast->body, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::if_ast: {
+            If_AST *if_ast = static_cast<If_AST*>(ast);
+            move_lines(if_ast->guard, delta, first_serial, last_serial);
+            move_lines(if_ast->then_block, delta, first_serial, last_serial);
+            move_lines(if_ast->else_block, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::assign_ast: {
+            Assign_AST *assign_ast = static_cast<Assign_AST*>(ast);
+            move_lines(assign_ast->lhs, delta, first_serial, last_serial);
+            move_lines(assign_ast->rhs, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::return_ast: {
+            Return_AST *return_ast = static_cast<Return_AST*>(ast);
+            move_lines(return_ast->expr, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::function_type_ast: {
+            Function_Type_AST *function_type_ast = static_cast<Function_Type_AST*>(ast);
+            for(u64 i = 0; i < function_type_ast->parameter_types.count; ++i)
+            {
+                move_lines(function_type_ast->parameter_types[i], delta, first_serial, last_serial);
+            }
+            for(u64 i = 0; i < function_type_ast->return_types.count; ++i)
+            {
+                move_lines(function_type_ast->return_types[i], delta, first_serial, last_serial);
+            }
+        } break;
+        case AST_Type::function_ast: {
+            Function_AST *function_ast = static_cast<Function_AST*>(ast);
+            move_lines(function_ast->prototype, delta, first_serial, last_serial);
+            for(u64 i = 0; i < function_ast->param_names.count; ++i)
+            {
+                move_lines(function_ast->param_names[i], delta, first_serial, last_serial);
+                move_lines(function_ast->default_values[i], delta, first_serial, last_serial);
+            }
+            move_lines(function_ast->block, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::function_call_ast: {
+            Function_Call_AST *function_call_ast = static_cast<Function_Call_AST*>(ast);
+            move_lines(function_call_ast->function, delta, first_serial, last_serial);
+            for(u64 i = 0; i < function_call_ast->args.count; ++i)
+            {
+                move_lines(function_call_ast->args[i], delta, first_serial, last_serial);
+            }
+        } break;
+        case AST_Type::access_ast: {
+            Access_AST *access_ast = static_cast<Access_AST*>(ast);
+            move_lines(access_ast->lhs, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::binary_operator_ast: {
+            Binary_Operator_AST *binop_ast = static_cast<Binary_Operator_AST*>(ast);
+            move_lines(binop_ast->lhs, delta, first_serial, last_serial);
+            move_lines(binop_ast->rhs, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::enum_ast: {
+            Enum_AST *enum_ast = static_cast<Enum_AST*>(ast);
+            move_lines(enum_ast->underlying_type, delta, first_serial, last_serial);
+            for(u64 i = 0; i < enum_ast->values.count; ++i)
+            {
+                move_lines(enum_ast->values[i], delta, first_serial, last_serial);
+            }
+        } break;
+        case AST_Type::struct_ast: {
+            Struct_AST *struct_ast = static_cast<Struct_AST*>(ast);
+            for(u64 i = 0; i < struct_ast->constants.count; ++i)
+            {
+                move_lines(struct_ast->constants[i], delta, first_serial, last_serial);
+            }
+            for(u64 i = 0; i < struct_ast->fields.count; ++i)
+            {
+                move_lines(struct_ast->fields[i], delta, first_serial, last_serial);
+            }
+        } break;
+        case AST_Type::unary_ast: {
+            Unary_Operator_AST *unop_ast = static_cast<Unary_Operator_AST*>(ast);
+            move_lines(unop_ast->operand, delta, first_serial, last_serial);
+        } break;
+        case AST_Type::ident_ast:
+        case AST_Type::number_ast:
+        case AST_Type::primitive_ast:
+        case AST_Type::string_ast:
+        case AST_Type::bool_ast: {
+            // Do nothing
+        } break;
+    }
+}
+
+// Note: hashes the tokens, and where they are relative to the first one, so a declaration that is
+// only moved to other lines keeps its hash, but one that is laid out differently does not
+internal
+u64 hash_decl_tokens(Token *tokens, u64 count)
+{
+    u64 hash = 0;
+    for(u64 i = 0; i < count; ++i)
+    {
+        u64 position = ((u64)(tokens[i].line_number - tokens[0].line_number) << 32) | tokens[i].line_offset;
+        hash = hash_string(tokens[i].contents, hash ^ position ^ ((u64)tokens[i].type << 56));
+    }
+    return hash;
+}
+
+Decl_Record make_decl_record(Decl_AST *decl, Array<Token> tokens, Token_Span span, u32 first_serial)
+{
+    Decl_Record record;
+    zero_struct(&record);
+    record.decl = decl;
+    record.first_serial = first_serial;
+    
+    Token *first = &tokens[span.first];
+    record.text_hash = hash_decl_tokens(first, span.count);
+    record.interface_hash = record.text_hash;
+    if(decl->expr && decl->expr->type == AST_Type::function_ast)
+    {
+        Block_AST *block = static_cast<Function_AST*>(decl->expr)->block;
+        for(u64 i = 0; i < span.count; ++i)
+        {
+            if(first[i].line_number == block->line_number && first[i].line_offset == block->line_offset)
+            {
+                record.interface_hash = hash_decl_tokens(first, i);
+                break;
+            }
+        }
+    }
+    return record;
+}
+
+internal
+int compare_decl_references(const void *p1, const void *p2)
+{
+    const Decl_Reference *r1 = (const Decl_Reference*)p1;
+    const Decl_Reference *r2 = (const Decl_Reference*)p2;
+    if(r1->atom.id != r2->atom.id)
+    {
+        return (r1->atom.id < r2->atom.id) ? -1 : 1;
+    }
+    if(r1->decl_index != r2->decl_index)
+    {
+        return (r1->decl_index < r2->decl_index) ? -1 : 1;
+    }
+    return (int)r1->from_body - (int)r2->from_body;
+}
+
+// Note: sorts by referring declaration, then the references from outside of function bodies first
+internal
+int compare_decl_references_by_decl(const void *p1, const void *p2)
+{
+    const Decl_Reference *r1 = (const Decl_Reference*)p1;
+    const Decl_Reference *r2 = (const Decl_Reference*)p2;
+    if(r1->decl_index != r2->decl_index)
+    {
+        return (r1->decl_index < r2->decl_index) ? -1 : 1;
+    }
+    if(r1->from_body != r2->from_body)
+    {
+        return (int)r1->from_body - (int)r2->from_body;
+    }
+    if(r1->atom.id != r2->atom.id)
+    {
+        return (r1->atom.id < r2->atom.id) ? -1 : 1;
+    }
+    return 0;
+}
+
+void plan_incremental_check(Compilation *comp, Array<Decl_AST*> decls, Array<Decl_Record> records, Array<bool> kept)
+{
+    Array<Decl_Record> old_records = comp->decl_records.array;
+    // Note: the new declarations are not scoped yet, so their idents are still strings
+    Dynamic_Array<Atom> names = {0};
+    for(u64 i = 0; i < decls.count; ++i)
+    {
+        array_add(&names, atomize_string(&comp->atom_table, decls[i]->ident.ident));
+    }
+    u64 atom_count = comp->atom_table.strings.count;
+    
+    // Note: indexed by atom id, one past the old and new position of each top-level name
+    Dynamic_Array<u32> old_positions = {0};
+    Dynamic_Array<u32> new_positions = {0};
+    Dynamic_Array<bool> type_changed = {0};
+    Dynamic_Array<Atom> changed_names = {0};
+    Dynamic_Array<Decl_Reference> dependents = {0};
+    defer {
+        array_free(&names);
+        array_free(&old_positions);
+        array_free(&new_positions);
+        array_free(&type_changed);
+        array_free(&changed_names);
+        array_free(&dependents);
+    };
+    array_resize(&old_positions, atom_count);
+    array_resize(&new_positions, atom_count);
+    array_resize(&type_changed, atom_count);
+    old_positions.count = atom_count;
+    new_positions.count = atom_count;
+    type_changed.count = atom_count;
+    zero_memory(old_positions.data, atom_count);
+    zero_memory(new_positions.data, atom_count);
+    zero_memory(type_changed.data, atom_count);
+    
+    auto change_type = [&](Atom atom) {
+        if(!type_changed[atom.id])
+        {
+            type_changed[atom.id] = true;
+            array_add(&changed_names, atom);
+        }
+    };
+    
+    for(u64 i = 0; i < old_records.count; ++i)
+    {
+        old_positions[old_records[i].decl->ident.atom.id] = (u32)(i + 1);
+    }
+    for(u64 i = 0; i < decls.count; ++i)
+    {
+        Atom atom = names[i];
+        if(new_positions[atom.id])
+        {
+            // Note: a redeclaration, which scoping reports, so there is nothing to keep
+            return;
+        }
+        new_positions[atom.id] = (u32)(i + 1);
+    }
+    
+    for(u64 i = 0; i < decls.count; ++i)
+    {
+        Atom atom = names[i];
+        u32 old_position = old_positions[atom.id];
+        if(!old_position)
+        {
+            change_type(atom);
+            continue;
+        }
+        Decl_Record *old = &old_records[old_position - 1];
+        // Note: the columns are not moved, only the lines
+        bool moved_across = (old->decl->line_offset != decls[i]->line_offset);
+        kept[i] = !moved_across && old->text_hash == records[i].text_hash;
+        if(moved_across || old->interface_hash != records[i].interface_hash)
+        {
+            change_type(atom);
+        }
+        for(u64 j = 0; j < old->references.count; ++j)
+        {
+            Decl_Reference dependent;
+            dependent.decl_index = (u32)i;
+            dependent.atom = old->references[j];
+            dependent.from_body = (j >= old->interface_count);
+            array_add(&dependents, dependent);
+        }
+    }
+    for(u64 i = 0; i < old_records.count; ++i)
+    {
+        Atom atom = old_records[i].decl->ident.atom;
+        if(!new_positions[atom.id])
+        {
+            change_type(atom);
+        }
+    }
+    
+    // Note: the references of a declaration that changed, but not outside of its function bodies,
+    // are the same there as before
+    qsort(dependents.data, dependents.count, sizeof(Decl_Reference), compare_decl_references);
+    for(u64 i = 0; i < changed_names.count; ++i)
+    {
+        Atom atom = changed_names[i];
+        u64 low = 0;
+        u64 high = dependents.count;
+        while(low < high)
+        {
+            u64 mid = low + (high - low) / 2;
+            if(dependents[mid].atom.id < atom.id)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+        for(u64 j = low; j < dependents.count && dependents[j].atom.id == atom.id; ++j)
+        {
+            u32 decl_index = dependents[j].decl_index;
+            kept[decl_index] = false;
+            if(!dependents[j].from_body)
+            {
+                change_type(names[decl_index]);
+            }
+        }
+    }
+    
+    for(u64 i = 0; i < decls.count; ++i)
+    {
+        u32 old_position = old_positions[names[i].id];
+        if(!old_position)
+        {
+            continue;
+        }
+        Decl_Record *old = &old_records[old_position - 1];
+        if(kept[i])
+        {
+            s64 delta = (s64)decls[i]->line_number - (s64)old->decl->line_number;
+            if(delta)
+            {
+                move_lines(old->decl, delta, old->first_serial, old->decl->ident.s);
+            }
+            records[i] = *old;
+        }
+        else
+        {
+            *old->decl = *decls[i];
+            records[i].decl = old->decl;
+        }
+        decls[i] = old->decl;
+    }
+}
+
+void add_decl_references(Compilation *comp, Array<Decl_Reference> references, Array<Decl_Record> records, Array<bool> kept)
+{
+    qsort(references.data, references.count, sizeof(Decl_Reference), compare_decl_references_by_decl);
+    u64 i = 0;
+    while(i < references.count)
+    {
+        u32 decl_index = references[i].decl_index;
+        u64 end = i;
+        while(end < references.count && references[end].decl_index == decl_index)
+        {
+            ++end;
+        }
+        Decl_Record *record = &records[decl_index];
+        if(!kept[decl_index])
+        {
+            record->references.data = pool_alloc(Atom, end - i, &comp->ast_pool);
+            record->references.count = 0;
+            record->interface_count = 0;
+            for(u64 j = i; j < end; ++j)
+            {
+                // Note: the same declaration can be referred to many times, and from itself
+                Atom atom = references[j].atom;
+                u64 count = record->references.count;
+                if(atom == record->decl->ident.atom || (count && record->references[count - 1] == atom))
+                {
+                    continue;
+                }
+                record->references[record->references.count++] = atom;
+                if(!references[j].from_body)
+                {
+                    ++record->interface_count;
+                }
+            }
+        }
+        i = end;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "ast.h"
+#include "basic.h"
+#include "lex.h"
+#include "parse.h"
+#include "scope.h"
+
+// Note: what a compilation keeps of a top-level declaration, so that the next one only typechecks
+// the declarations that changed, and those that depend on them
+struct Decl_Record
+{
+    // Note: a new version of the declaration is copied into this one, so that the identifiers that
+    // refer to it from the declarations that are kept stay valid
+    Decl_AST *decl;
+    // Note: of its tokens, and where they are relative to the first one
+    u64 text_hash;
+    // Note: the same up to the body of a function, which can't change its type
+    u64 interface_hash;
+    // Note: the nodes parsed for the declaration have serials from this up to its ident's
+    u32 first_serial;
+    // Note: the other top-level declarations it refers to, the first interface_count of them from
+    // outside of function bodies
+    Array<Atom> references;
+    u64 interface_count;
+};
+
+struct Compilation;
+
+// Note: span is the declaration's tokens, and first_serial the serial of the first node parsed for it
+Decl_Record make_decl_record(Decl_AST *decl, Array<Token> tokens, Token_Span span, u32 first_serial);
+// Note: decides which declarations of the new version are typechecked. One is, if its text changed,
+// or if it refers to one whose type may have changed: one that is new, gone, or had its text
+// outside of function bodies changed, or that refers to such a one from outside of its function
+// bodies, and so on. The others are kept, which replaces them in decls by the old declaration,
+// moved to the new lines. A declaration that is typechecked again is copied into the old one
+void plan_incremental_check(Compilation *comp, Array<Decl_AST*> decls, Array<Decl_Record> records, Array<bool> kept);
+// Note: references are the ones found while scoping decls, the records of the declarations that
+// were not kept get theirs
+void add_decl_references(Compilation *comp, Array<Decl_Reference> references, Array<Decl_Record> records, Array<bool> kept);
+
+#endif // INCREMENTAL_H
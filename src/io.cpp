@@ -3,6 +3,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 
 // TODO: defer
 // would be nice for e.g. close(fd)
@@ -50,6 +52,51 @@ String read_entire_file(const byte *file_name)
     return result;
 }
 
+u64 get_resident_memory()
+{
+    // Note: Linux only, /proc/self/statm is "size resident shared ..." in pages
+    int fd = open("/proc/self/statm", O_CLOEXEC | O_RDONLY, 0);
+    if(fd < 0)
+    {
+        return 0;
+    }
+    defer {
+        close(fd);
+    };
+    
+    byte buffer[128];
+    s64 len = read(fd, buffer, sizeof(buffer) - 1);
+    if(len <= 0)
+    {
+        return 0;
+    }
+    buffer[len] = '\0';
+    
+    byte *point = buffer;
+    while(*point && *point != ' ')
+    {
+        ++point;
+    }
+    while(*point == ' ')
+    {
+        ++point;
+    }
+    
+    u64 pages = 0;
+    while(*point >= '0' && *point <= '9')
+    {
+        pages = pages*10 + (*point - '0');
+        ++point;
+    }
+    
+    return pages * sysconf(_SC_PAGESIZE);
+}
+u64 read_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000UL + (u64)ts.tv_nsec;
+}
 
 Print_Buffer make_print_buffer(int fd, u64 buffer_size)
 {
@@ -83,6 +130,8 @@ Print_Buffer make_file_print_buffer(const byte *file_name, u64 buffer_size)
 
 Print_Buffer stdout_buf;
 Print_Buffer stderr_buf;
+// Note: print and print_err may be called from several threads, e.g. by a pool allocating a block
+internal pthread_mutex_t std_print_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void init_std_print_buffers(u64 stdout_size, u64 stderr_size)
 {
@@ -119,7 +168,9 @@ void print(const byte *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
+    pthread_mutex_lock(&std_print_lock);
     vprint_buf(&stdout_buf, fmt, args);
+    pthread_mutex_unlock(&std_print_lock);
     va_end(args);
 }
 
@@ -127,7 +178,9 @@ void print_err(const byte *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
+    pthread_mutex_lock(&std_print_lock);
     vprint_buf(&stderr_buf, fmt, args);
+    pthread_mutex_unlock(&std_print_lock);
     va_end(args);
 }
 
@@ -15,6 +15,10 @@ struct Print_Buffer
 };
 
 String read_entire_file(const byte *file_name);
+// Note: returns 0 if the resident set size is not available
+u64 get_resident_memory();
+// Note: monotonic clock, for timing
+u64 read_clock_ns();
 
 Print_Buffer make_print_buffer(int fd, u64 buffer_size = 1024);
 Print_Buffer make_file_print_buffer(const byte *file_name, u64 buffer_size = 1024);
@@ -0,0 +1,163 @@
+
+void init_job_chunk_pool(Job_Chunk_Pool *chunks)
+{
+    pool_init(&chunks->pool, 16 * sizeof(Job_Chunk));
+    chunks->free_chunks = nullptr;
+}
+
+void free_job_chunk_pool(Job_Chunk_Pool *chunks)
+{
+    pool_release(&chunks->pool);
+    chunks->free_chunks = nullptr;
+}
+
+void init_job_queue(Job_Queue *queue, Job_Chunk_Pool *chunks)
+{
+    queue->chunks = chunks;
+    queue->first = nullptr;
+    queue->last = nullptr;
+    queue->count = 0;
+}
+
+internal
+Job_Chunk *get_job_chunk(Job_Chunk_Pool *chunks)
+{
+    Job_Chunk *chunk = chunks->free_chunks;
+    if(chunk)
+    {
+        chunks->free_chunks = chunk->next;
+    }
+    else
+    {
+        chunk = pool_alloc(Job_Chunk, &chunks->pool);
+    }
+    chunk->begin = 0;
+    chunk->end = 0;
+    return chunk;
+}
+
+// Note: the chunk must be empty, it is kept for the next one that is needed
+internal
+void unlink_job_chunk(Job_Queue *queue, Job_Chunk *chunk)
+{
+    if(chunk->prev)
+    {
+        chunk->prev->next = chunk->next;
+    }
+    else
+    {
+        queue->first = chunk->next;
+    }
+    if(chunk->next)
+    {
+        chunk->next->prev = chunk->prev;
+    }
+    else
+    {
+        queue->last = chunk->prev;
+    }
+    chunk->next = queue->chunks->free_chunks;
+    queue->chunks->free_chunks = chunk;
+}
+
+internal
+Job_Chunk *add_job_chunk(Job_Queue *queue)
+{
+    Job_Chunk *chunk = get_job_chunk(queue->chunks);
+    chunk->prev = queue->last;
+    chunk->next = nullptr;
+    if(queue->last)
+    {
+        queue->last->next = chunk;
+    }
+    else
+    {
+        queue->first = chunk;
+    }
+    queue->last = chunk;
+    return chunk;
+}
+
+void push_job(Job_Queue *queue, Job job)
+{
+    Job_Chunk *chunk = queue->last;
+    if(!chunk || chunk->end == JOB_CHUNK_CAPACITY)
+    {
+        chunk = add_job_chunk(queue);
+    }
+    chunk->jobs[chunk->end++] = job;
+    ++queue->count;
+}
+
+void push_jobs(Job_Queue *queue, Job *jobs, u64 count)
+{
+    queue->count += count;
+    while(count)
+    {
+        Job_Chunk *chunk = queue->last;
+        if(!chunk || chunk->end == JOB_CHUNK_CAPACITY)
+        {
+            chunk = add_job_chunk(queue);
+        }
+        u64 run = min(count, JOB_CHUNK_CAPACITY - chunk->end);
+        copy_memory(chunk->jobs + chunk->end, jobs, run);
+        chunk->end += (u32)run;
+        jobs += run;
+        count -= run;
+    }
+}
+
+bool pop_job_front(Job_Queue *queue, Job *job_out)
+{
+    Job_Chunk *chunk = queue->first;
+    if(!chunk)
+    {
+        return false;
+    }
+    *job_out = chunk->jobs[chunk->begin++];
+    --queue->count;
+    if(chunk->begin == chunk->end)
+    {
+        unlink_job_chunk(queue, chunk);
+    }
+    return true;
+}
+
+bool pop_job_back(Job_Queue *queue, Job *job_out)
+{
+    Job_Chunk *chunk = queue->last;
+    if(!chunk)
+    {
+        return false;
+    }
+    *job_out = chunk->jobs[--chunk->end];
+    --queue->count;
+    if(chunk->begin == chunk->end)
+    {
+        unlink_job_chunk(queue, chunk);
+    }
+    return true;
+}
+
+void append_job_queue(Job_Queue *queue, Job_Queue *from)
+{
+    assert(queue->chunks == from->chunks);
+    if(!from->first)
+    {
+        return;
+    }
+    if(queue->last)
+    {
+        queue->last->next = from->first;
+        from->first->prev = queue->last;
+    }
+    else
+    {
+        queue->first = from->first;
+    }
+    queue->last = from->last;
+    queue->count += from->count;
+    from->first = nullptr;
+    from->last = nullptr;
+    from->count = 0;
+}
@@ -0,0 +1,71 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include "ast.h"
+#include "basic.h"
+#include "pool_allocator.h"
+
+// Note: there can be millions of jobs, so a job is kept to two words. The stage is stored in the
+// low bits of the AST pointer, which are always clear, since ASTs are at least 8 byte aligned
+constexpr u64 JOB_STAGE_MASK = 7;
+
+struct Job
+{
+    u64 ast_and_stage;
+    // Note: the type the AST is expected to have, if any
+    Expr_AST *type;
+};
+
+static_assert(sizeof(Job) == 16, "Job should be two words");
+
+inline
+AST *job_ast(Job job) { return (AST*)(job.ast_and_stage & ~JOB_STAGE_MASK); }
+inline
+u32 job_stage(Job job) { return (u32)(job.ast_and_stage & JOB_STAGE_MASK); }
+
+// Note: sized so that a chunk fits in a page
+constexpr u64 JOB_CHUNK_CAPACITY = 254;
+
+struct Job_Chunk
+{
+    Job_Chunk *prev;
+    Job_Chunk *next;
+    // Note: the jobs in the chunk are jobs[begin] up to jobs[end - 1]
+    u32 begin;
+    u32 end;
+    Job jobs[JOB_CHUNK_CAPACITY];
+};
+
+// Note: where the chunks of one or more queues come from. A chunk that is emptied goes back to
+// free_chunks, so queues that are filled and drained every round stop allocating once they are
+// big enough. The queues that share one must not be used on different threads at the same time
+struct Job_Chunk_Pool
+{
+    Pool_Allocator pool;
+    Job_Chunk *free_chunks;
+};
+
+// Note: jobs can be pushed to the back, and taken from either end. Unlike a Dynamic_Array, it
+// never copies the jobs to grow
+struct Job_Queue
+{
+    Job_Chunk_Pool *chunks;
+    Job_Chunk *first;
+    Job_Chunk *last;
+    u64 count;
+};
+
+void init_job_chunk_pool(Job_Chunk_Pool *chunks);
+// Note: the queues that use it must not be used afterwards
+void free_job_chunk_pool(Job_Chunk_Pool *chunks);
+
+void init_job_queue(Job_Queue *queue, Job_Chunk_Pool *chunks);
+void push_job(Job_Queue *queue, Job job);
+void push_jobs(Job_Queue *queue, Job *jobs, u64 count);
+bool pop_job_front(Job_Queue *queue, Job *job_out);
+bool pop_job_back(Job_Queue *queue, Job *job_out);
+// Note: moves the jobs of from to the back of queue, without copying them. Both must use the same
+// chunk pool
+void append_job_queue(Job_Queue *queue, Job_Queue *from);
+
+#endif // JOB_QUEUE_H
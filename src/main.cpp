@@ -1,15 +1,3 @@
-
-inline
-u64 read_tsc()
-{
-    register u64 rax asm("rax");
-    register u64 rdx asm("rdx");
-    asm volatile ("rdtsc"
-                  : "=r" (rax), "=r" (rdx));
-    rax |= rdx << 32;
-    return rax;
-}
-
 // Note: success means 'ast' and all children have resolved types
 // Must check resolved_type to check if just 'ast' does, but not the children
 
@@ -248,55 +236,377 @@ void check_for_untyped(AST *ast)
 }
 
 
-int main(int argc, char **argv)
+void init_compilation(Compilation *comp)
 {
-    // Note: if this becomes multi-threaded, we can get rid of the globals (writes smaller than 4K are supposed to be atomic IIRC)
-    // Alternatively, formatting could occur in thread-local buffers, and output is guarded by a global mutex
-    init_std_print_buffers();
-    init_primitive_types();
-    
-    String file_contents = read_entire_file("test.txt");
+    pool_init(&comp->ast_pool, 4096);
+    init_atom_table(&comp->atom_table, 128, 4096);
+    comp->thread_count = 1;
+    comp->typecheck_stats = nullptr;
+    comp->entry_points = {0};
+    comp->print_enums = false;
+    comp->incremental = false;
+    comp->decl_records = {0};
+    comp->sources = {0};
+}
+
+void reset_compilation(Compilation *comp)
+{
+    pool_reset(&comp->ast_pool);
+    reset_atom_table(&comp->atom_table);
+    next_serial = first_compilation_serial;
+    comp->decl_records.count = 0;
+    for(u64 i = 0; i < comp->sources.count; ++i)
+    {
+        mem_dealloc(comp->sources[i].data, comp->sources[i].count);
+    }
+    comp->sources.count = 0;
+}
+
+// Note: prints the values of each enum, and the range they cover. Enums that were not typechecked
+// have no table yet, and are left out
+internal
+void print_enum_tables(Atom_Table *atom_table, Array<Decl_AST*> decls)
+{
+    for(u64 i = 0; i < decls.count; ++i)
+    {
+        Expr_AST *expr = decls[i]->expr;
+        if(!expr || expr->type != AST_Type::enum_ast || !static_cast<Enum_AST*>(expr)->table.values)
+        {
+            continue;
+        }
+        Enum_AST *enum_ast = static_cast<Enum_AST*>(expr);
+        Enum_Table *table = &enum_ast->table;
+        String name = atom_string(atom_table, decls[i]->ident.atom);
+        print_err("Enum %.*s:", (int)name.count, name.data);
+        for(u64 j = 0; j < enum_ast->values.count; ++j)
+        {
+            String value_name = atom_string(atom_table, enum_ast->values[j]->ident.atom);
+            print_err("%s %.*s = %lld", j ? "," : "", (int)value_name.count, value_name.data, table->values[j]);
+        }
+        print_err("; from %lld to %lld, %s\n", table->min_value, table->max_value, table->contiguous ? "contiguous" : "not contiguous");
+    }
+}
+
+internal
+bool compile_file(Compilation *comp, const byte *file_name)
+{
+    begin_tracked_phase(Alloc_Tag::source);
+    String file_contents = read_entire_file(file_name);
     if(!file_contents.data)
     {
-        print_err("Unable to read test.txt\n");
+        print_err("Unable to read %s\n", file_name);
+        return false;
     }
+    defer {
+        if(comp->incremental)
+        {
+            array_add(&comp->sources, file_contents);
+        }
+        else
+        {
+            mem_dealloc(file_contents.data, file_contents.count);
+        }
+    };
     
+    begin_tracked_phase(Alloc_Tag::tokens);
     Dynamic_Array<Token> tokens = lex_string(file_contents);
     if(!tokens.data)
     {
-        return 1;
+        return false;
     }
+    end_tracked_phase("lexing");
     
-    Pool_Allocator ast_pool;
-    Parsing_Context ctx;
+    begin_tracked_phase(Alloc_Tag::parse);
+    Dynamic_Array<Token_Span> decl_spans = {0};
+    Parsing_Context parsing_ctx;
+    init_parsing_context(&parsing_ctx, file_contents, tokens.array, &comp->ast_pool);
+    if(comp->incremental)
+    {
+        parsing_ctx.decl_spans = &decl_spans;
+    }
+    u32 first_serial = next_serial;
+    Dynamic_Array<Decl_AST*> decls = parse_tokens(&parsing_ctx);
     
-    pool_init(&ast_pool, 4096);
-    init_parsing_context(&ctx, file_contents, tokens.array, &ast_pool);
-    Dynamic_Array<Decl_AST*> decls = parse_tokens(&ctx);
+    // Note: kept is indexed like decls, and set for the declarations that are not typechecked again
+    Dynamic_Array<Decl_Record> records = {0};
+    Dynamic_Array<bool> kept = {0};
+    Dynamic_Array<Decl_Reference> references = {0};
+    Dynamic_Array<Decl_AST*> checked_decls = {0};
+    bool success = false;
+    defer {
+        array_free(&decls);
+        array_free(&decl_spans);
+        array_free(&kept);
+        array_free(&references);
+        array_free(&checked_decls);
+        // Note: after a failed compilation, the next one typechecks everything
+        array_free(&comp->decl_records);
+        if(success)
+        {
+            comp->decl_records = records;
+        }
+        else
+        {
+            array_free(&records);
+        }
+    };
+    if(comp->incremental)
+    {
+        for(u64 i = 0; i < decls.count; ++i)
+        {
+            u32 decl_first_serial = i ? decls[i - 1]->ident.s + 1 : first_serial;
+            array_add(&records, make_decl_record(decls[i], tokens.array, decl_spans[i], decl_first_serial));
+        }
+        array_resize(&kept, decls.count);
+        kept.count = decls.count;
+        zero_memory(kept.data, kept.count);
+        if(comp->decl_records.count)
+        {
+            plan_incremental_check(comp, decls.array, records.array, kept.array);
+        }
+    }
     
+    array_free(&tokens);
     array_trim(&decls);
+    end_tracked_phase("parsing");
     
-    Atom_Table atom_table;
-    init_atom_table(&atom_table, 128, 4096);
-    
+    begin_tracked_phase(Alloc_Tag::scope);
     Scoping_Context scoping_ctx;
-    scoping_ctx.atom_table = &atom_table;
-    scoping_ctx.ast_pool = &ast_pool;
-    bool success = create_scope_metadata(&scoping_ctx, decls.array);
-    if(!success)
+    init_scoping_context(&scoping_ctx, &comp->atom_table, &comp->ast_pool);
+    if(comp->incremental)
     {
-        return 1;
+        scoping_ctx.decl_references = &references;
+    }
+    
+    if(!create_scope_metadata(&scoping_ctx, decls.array, kept.array))
+    {
+        return false;
+    }
+    end_tracked_phase("scoping");
+    
+    for(u64 i = 0; i < decls.count; ++i)
+    {
+        if(!kept.count || !kept[i])
+        {
+            array_add(&checked_decls, decls[i]);
+        }
     }
-    success = typecheck_all(&ast_pool, decls.array);
-    if(!success)
+    if(comp->incremental && comp->decl_records.count)
+    {
+        print_err("Typechecking %lu of %lu declarations\n", checked_decls.count, decls.count);
+    }
+    
+    begin_tracked_phase(Alloc_Tag::typecheck);
+    if(!typecheck_all(&comp->ast_pool, &comp->atom_table, checked_decls.array, comp->thread_count, comp->typecheck_stats, comp->entry_points))
     {
         print_err("No success\n");
+        return false;
+    }
+    end_tracked_phase("typechecking");
+    
+    for(u64 i = 0; i < checked_decls.count; ++i)
+    {
+        // Note: a declaration that no entry point uses was not typechecked
+        if(comp->entry_points.count && !type_resolved(&checked_decls[i]->ident))
+        {
+            continue;
+        }
+        check_for_untyped(checked_decls[i]);
+    }
+    if(comp->print_enums)
+    {
+        print_enum_tables(&comp->atom_table, decls.array);
+    }
+    
+    if(comp->incremental)
+    {
+        add_decl_references(comp, references.array, records.array, kept.array);
+    }
+    success = true;
+    return true;
+}
+
+internal
+bool parse_u64(const byte *str, u64 *result)
+{
+    *result = 0;
+    if(!*str)
+    {
+        return false;
+    }
+    for(; *str; ++str)
+    {
+        if(*str < '0' || *str > '9')
+        {
+            return false;
+        }
+        *result = *result*10 + (*str - '0');
+    }
+    return true;
+}
+
+// Usage: test.exe [file] [-repeat N] [-threads N] [-random-hash-seed] [-bench NAME] [-typecheck-stats] [-typecheck-stats-json] [-entry NAME] [-edit FILE] [-print-enums]
+// -repeat compiles the file N times in one process, reusing the Compilation memory,
+// and reports the resident memory after the first and the last compilation
+// -threads typechecks on N threads. The diagnostics are printed sorted by location, so they are the
+// same with any number of threads
+// -bench runs the named benchmark on the file instead of compiling it
+// -typecheck-stats prints the rounds, jobs, yields and cycles of the typechecker by AST type,
+// -typecheck-stats-json prints the same as JSON to stdout. With -repeat, they add up all compilations
+// -entry typechecks only the named declaration and what it uses, it can be given more than once.
+// The rest of the file is still parsed and scoped
+// -edit compiles FILE after the file, as a new version of it, only typechecking the declarations
+// that changed and those that depend on them. It can be given more than once, for a series of edits
+// -print-enums prints the values of each top-level enum, and whether they are contiguous
+int main(int argc, char **argv)
+{
+    // Note: printing is guarded by a global mutex, since typechecking may be multi-threaded
+    init_std_print_buffers();
+    init_primitive_types();
+    init_allocation_tracking();
+    
+    const byte *file_name = "test.txt";
+    const byte *bench_name = nullptr;
+    u64 repeat_count = 1;
+    u64 thread_count = 1;
+    bool print_stats = false;
+    bool print_stats_json = false;
+    bool print_enums = false;
+    Dynamic_Array<String> entry_points = {0};
+    Dynamic_Array<const byte*> edit_file_names = {0};
+    defer {
+        array_free(&entry_points);
+        array_free(&edit_file_names);
+    };
+    for(int i = 1; i < argc; ++i)
+    {
+        if(c_string(argv[i]) == str_lit("-repeat"))
+        {
+            ++i;
+            if(i == argc || !parse_u64(argv[i], &repeat_count) || repeat_count == 0)
+            {
+                print_err("Expected a positive count after -repeat\n");
+                return 1;
+            }
+        }
+        else if(c_string(argv[i]) == str_lit("-threads"))
+        {
+            ++i;
+            if(i == argc || !parse_u64(argv[i], &thread_count) || thread_count == 0)
+            {
+                print_err("Expected a positive count after -threads\n");
+                return 1;
+            }
+        }
+        else if(c_string(argv[i]) == str_lit("-entry"))
+        {
+            ++i;
+            if(i == argc)
+            {
+                print_err("Expected a declaration name after -entry\n");
+                return 1;
+            }
+            array_add(&entry_points, c_string(argv[i]));
+        }
+        else if(c_string(argv[i]) == str_lit("-edit"))
+        {
+            ++i;
+            if(i == argc)
+            {
+                print_err("Expected a file name after -edit\n");
+                return 1;
+            }
+            array_add(&edit_file_names, (const byte*)argv[i]);
+        }
+        else if(c_string(argv[i]) == str_lit("-print-enums"))
+        {
+            print_enums = true;
+        }
+        else if(c_string(argv[i]) == str_lit("-typecheck-stats"))
+        {
+            print_stats = true;
+        }
+        else if(c_string(argv[i]) == str_lit("-typecheck-stats-json"))
+        {
+            print_stats_json = true;
+        }
+        else if(c_string(argv[i]) == str_lit("-random-hash-seed"))
+        {
+            randomize_string_hash_seed();
+        }
+        else if(c_string(argv[i]) == str_lit("-bench"))
+        {
+            ++i;
+            if(i == argc)
+            {
+                print_err("Expected a benchmark name after -bench\n");
+                return 1;
+            }
+            bench_name = argv[i];
+        }
+        else
+        {
+            file_name = argv[i];
+        }
+    }
+    
+    if(bench_name)
+    {
+        return run_benchmark(bench_name, file_name) ? 0 : 1;
+    }
+    // Note: the declarations that are not used are left unresolved, so they can't be kept
+    if(edit_file_names.count && entry_points.count)
+    {
+        print_err("-edit can't be combined with -entry\n");
         return 1;
     }
     
-    for(u64 i = 0; i < decls.count; ++i)
+    Compilation comp;
+    init_compilation(&comp);
+    comp.thread_count = thread_count;
+    comp.entry_points = entry_points.array;
+    comp.print_enums = print_enums;
+    comp.incremental = (edit_file_names.count > 0);
+    Typecheck_Stats stats;
+    zero_struct(&stats);
+    if(print_stats || print_stats_json)
+    {
+        comp.typecheck_stats = &stats;
+    }
+    // Note: printed even if compiling fails, since stalls are worth profiling too
+    defer {
+        if(print_stats)
+        {
+            print_typecheck_stats(&stats);
+        }
+        if(print_stats_json)
+        {
+            print_typecheck_stats_json(&stats);
+        }
+    };
+    
+    for(u64 i = 0; i < repeat_count; ++i)
     {
-        check_for_untyped(decls[i]);
+        bool success = compile_file(&comp, file_name);
+        // Note: a version that fails doesn't stop the ones after it, they typecheck everything
+        for(u64 j = 0; j < edit_file_names.count; ++j)
+        {
+            if(!compile_file(&comp, edit_file_names[j]))
+            {
+                success = false;
+            }
+        }
+        reset_compilation(&comp);
+        end_tracked_phase("cleanup");
+        if(!success)
+        {
+            return 1;
+        }
+        
+        if(repeat_count > 1 && (i == 0 || i + 1 == repeat_count))
+        {
+            print_err("Resident memory after compilation %lu: %lu KiB\n", i + 1, get_resident_memory() / 1024);
+        }
     }
     
     return 0;
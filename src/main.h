@@ -2,7 +2,43 @@
 #define MAIN_H
 
 #include "basic.h"
+#include "check.h"
+#include "incremental.h"
+#include "pool_allocator.h"
+#include "scope.h"
 
 void report_error(byte *program_text, u32 line_number, u32 line_offset, String error_text);
 
+// Memory that is reused from one compilation to the next (the AST pool also holds the scopes)
+// Everything else is owned by a single phase, and freed when the phase that last uses it is done:
+//   source text: until the end of the compilation (the AST points into it), or until the
+//     compilation is reset if it is incremental
+//   tokens: until parsing is done
+//   typechecking job queues: until typechecking is done
+struct Compilation
+{
+    Pool_Allocator ast_pool;
+    Atom_Table atom_table;
+    // Note: the number of threads to typecheck on
+    u64 thread_count;
+    // Note: if set, the typechecker's stats of every compilation are added to it
+    Typecheck_Stats *typecheck_stats;
+    // Note: if there are any, only the declarations they use are typechecked
+    Array<String> entry_points;
+    // Note: if set, the value table of each top-level enum is printed after typechecking
+    bool print_enums;
+    // Note: if set, each compilation is of a new version of the same file, and keeps its AST, so
+    // that the next one only typechecks what changed
+    bool incremental;
+    // Note: empty unless the last compilation was incremental, and succeeded
+    Dynamic_Array<Decl_Record> decl_records;
+    // Note: the text of every version since the last reset, the kept declarations point into them
+    Dynamic_Array<String> sources;
+};
+
+void init_compilation(Compilation *comp);
+// Note: invalidates all ASTs and atoms of the previous compilation, the next incremental one
+// typechecks everything
+void reset_compilation(Compilation *comp);
+
 #endif // MAIN_H
\ No newline at end of file
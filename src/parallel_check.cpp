@@ -0,0 +1,387 @@
+
+void push_typecheck_jobs(Typecheck_Worker *worker, Job *jobs, u64 count)
+{
+    if(count == 0)
+    {
+        return;
+    }
+    __atomic_fetch_add(&worker->shared->pending, count, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&worker->deque_lock);
+    push_jobs(&worker->deque, jobs, count);
+    pthread_mutex_unlock(&worker->deque_lock);
+}
+
+internal
+bool pop_job(Typecheck_Worker *worker, Job *job_out)
+{
+    pthread_mutex_lock(&worker->deque_lock);
+    bool found = pop_job_back(&worker->deque, job_out);
+    pthread_mutex_unlock(&worker->deque_lock);
+    return found;
+}
+
+internal
+bool steal_job(Typecheck_Worker *worker, Job *job_out)
+{
+    Parallel_Typecheck *shared = worker->shared;
+    for(u64 i = 1; i < shared->worker_count; ++i)
+    {
+        Typecheck_Worker *victim = &shared->workers[(worker->index + i) % shared->worker_count];
+        pthread_mutex_lock(&victim->deque_lock);
+        bool found = pop_job_front(&victim->deque, job_out);
+        pthread_mutex_unlock(&victim->deque_lock);
+        if(found)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Note: moves all the jobs of from to the deque, taking the lock once. Moved in reverse, the owner
+// pops them in their order in from
+internal
+void push_queued_jobs(Typecheck_Worker *worker, Job_Queue *from, bool reverse)
+{
+    __atomic_fetch_add(&worker->shared->pending, from->count, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&worker->deque_lock);
+    Job job;
+    while(reverse ? pop_job_back(from, &job) : pop_job_front(from, &job))
+    {
+        push_job(&worker->deque, job);
+    }
+    pthread_mutex_unlock(&worker->deque_lock);
+}
+
+internal
+Shared_Parked_Job *take_parked_jobs(Parallel_Typecheck *shared, Expr_AST *expr)
+{
+    pthread_mutex_t *lock = &shared->wait_locks[expr->s % WAIT_LOCK_COUNT];
+    pthread_mutex_lock(lock);
+    Shared_Parked_Job *parked = shared->wait_lists[expr->s];
+    __atomic_store_n(&shared->wait_lists[expr->s], nullptr, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(lock);
+    return parked;
+}
+
+void schedule_shared_jobs(Typecheck_Worker *worker, Job *jobs, u64 count)
+{
+    if(worker->shared->round == 0)
+    {
+        push_jobs(&worker->retry_jobs, jobs, count);
+    }
+    else
+    {
+        push_typecheck_jobs(worker, jobs, count);
+    }
+}
+
+// Note: like on one thread, the jobs woken while the declarations are seeded run in the first round
+internal
+void wake_parked_jobs(Typecheck_Worker *worker, Shared_Parked_Job *parked)
+{
+    Job batch[JOB_BATCH_SIZE];
+    u64 count = 0;
+    for(; parked; parked = parked->next)
+    {
+        batch[count++] = parked->job;
+        if(count == JOB_BATCH_SIZE || !parked->next)
+        {
+            schedule_shared_jobs(worker, batch, count);
+            __atomic_fetch_sub(&worker->shared->parked_count, count, __ATOMIC_RELAXED);
+            count = 0;
+        }
+    }
+}
+
+// Note: the resolving thread stores the count, then looks for parked jobs, while the parking
+// thread adds the job, then looks at the count. Both are sequentially consistent, so at least
+// one of them sees the other, and the job is always woken
+void publish_resolved_type(Typecheck_Worker *worker, Expr_AST *expr)
+{
+    Parallel_Typecheck *shared = worker->shared;
+    __atomic_store_n(&expr->types.count, 1, __ATOMIC_SEQ_CST);
+    
+    // Note: nodes made while typechecking are resolved as they are made, so none wait on them
+    if(expr->s >= shared->wait_list_count || !__atomic_load_n(&shared->wait_lists[expr->s], __ATOMIC_SEQ_CST))
+    {
+        return;
+    }
+    wake_parked_jobs(worker, take_parked_jobs(shared, expr));
+}
+
+void park_shared_job(Typecheck_Worker *worker, Expr_AST *expr, Job job)
+{
+    Parallel_Typecheck *shared = worker->shared;
+    assert(expr->s < shared->wait_list_count);
+    
+    Shared_Parked_Job *parked = pool_alloc(Shared_Parked_Job, &worker->parked_pool);
+    parked->job = job;
+    parked->node = expr;
+    __atomic_fetch_add(&shared->parked_count, 1, __ATOMIC_RELAXED);
+    
+    pthread_mutex_t *lock = &shared->wait_locks[expr->s % WAIT_LOCK_COUNT];
+    pthread_mutex_lock(lock);
+    parked->next = shared->wait_lists[expr->s];
+    __atomic_store_n(&shared->wait_lists[expr->s], parked, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(lock);
+    
+    if(type_resolved(expr))
+    {
+        wake_parked_jobs(worker, take_parked_jobs(shared, expr));
+    }
+}
+
+internal
+void run_jobs(Typecheck_Worker *worker)
+{
+    Parallel_Typecheck *shared = worker->shared;
+    Job job;
+    while(true)
+    {
+        if(pop_job(worker, &job) || steal_job(worker, &job))
+        {
+            if(do_typecheck_job(&worker->ctx, job))
+            {
+                worker->change = true;
+            }
+            __atomic_fetch_sub(&shared->pending, 1, __ATOMIC_ACQ_REL);
+        }
+        else if(__atomic_load_n(&shared->pending, __ATOMIC_ACQUIRE) == 0)
+        {
+            return;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+}
+
+// Note: run by one worker, while the others wait at the barrier
+// Like on one thread, the rounds go on after a job fails, until nothing changes, so the same
+// diagnostics are reported no matter how the jobs were scheduled
+internal
+void end_round(Parallel_Typecheck *shared)
+{
+    bool change = false;
+    u64 retry_count = 0;
+    for(u64 i = 0; i < shared->worker_count; ++i)
+    {
+        Typecheck_Worker *worker = &shared->workers[i];
+        change = change || worker->change;
+        retry_count += worker->retry_jobs.count;
+        worker->change = false;
+    }
+    ++shared->round;
+    
+    if(retry_count == 0 && shared->parked_count == 0)
+    {
+        shared->done = true;
+        return;
+    }
+    // Note: with nothing to retry, the parked jobs would only be woken by a job that is running,
+    // and none are, so there is no need for another round to find that nothing changes
+    if(!change || retry_count == 0)
+    {
+        shared->stalled = true;
+        shared->done = true;
+        return;
+    }
+    
+    for(u64 i = 0; i < shared->worker_count; ++i)
+    {
+        Typecheck_Worker *worker = &shared->workers[i];
+        push_queued_jobs(worker, &worker->retry_jobs, false);
+    }
+}
+
+internal
+void *typecheck_worker_main(void *data)
+{
+    Typecheck_Worker *worker = static_cast<Typecheck_Worker*>(data);
+    Parallel_Typecheck *shared = worker->shared;
+    diagnostic_buffer = &worker->diagnostics;
+    defer {
+        diagnostic_buffer = nullptr;
+    };
+    
+    // Note: like on one thread, the first round checks the signatures, then the function bodies
+    run_jobs(worker);
+    pthread_barrier_wait(&shared->barrier);
+    worker->ctx.deferred_bodies = nullptr;
+    push_queued_jobs(worker, &worker->deferred_bodies, true);
+    pthread_barrier_wait(&shared->barrier);
+    
+    while(true)
+    {
+        run_jobs(worker);
+        pthread_barrier_wait(&shared->barrier);
+        if(worker->index == 0)
+        {
+            end_round(shared);
+        }
+        pthread_barrier_wait(&shared->barrier);
+        if(shared->done)
+        {
+            return nullptr;
+        }
+    }
+}
+
+internal
+void add_stalled_jobs(Parallel_Typecheck *shared, Dynamic_Array<Stalled_Job> *stalled)
+{
+    for(u64 i = 0; i < shared->worker_count; ++i)
+    {
+        Job retry;
+        while(pop_job_front(&shared->workers[i].retry_jobs, &retry))
+        {
+            Stalled_Job job = {retry, nullptr};
+            array_add(stalled, job);
+        }
+    }
+    for(u64 s = 0; s < shared->wait_list_count; ++s)
+    {
+        for(Shared_Parked_Job *parked = shared->wait_lists[s]; parked; parked = parked->next)
+        {
+            Stalled_Job job = {parked->job, parked->node};
+            array_add(stalled, job);
+        }
+    }
+}
+
+bool typecheck_all_parallel(Pool_Allocator *ast_pool, Atom_Table *atom_table, Array<Decl_AST*> decls, u64 thread_count, Typecheck_Stats *stats, Unchecked_Decls *unchecked_decls)
+{
+    Parallel_Typecheck shared;
+    zero_struct(&shared);
+    shared.worker_count = thread_count;
+    shared.workers = mem_alloc(Typecheck_Worker, thread_count);
+    shared.wait_list_count = next_serial;
+    shared.wait_lists = mem_alloc(Shared_Parked_Job*, shared.wait_list_count);
+    zero_memory(shared.wait_lists, shared.wait_list_count);
+    for(u64 i = 0; i < WAIT_LOCK_COUNT; ++i)
+    {
+        pthread_mutex_init(&shared.wait_locks[i], nullptr);
+    }
+    pthread_barrier_init(&shared.barrier, nullptr, (unsigned)thread_count);
+    Type_Table type_table;
+    init_type_table(&type_table, next_serial);
+    
+    for(u64 i = 0; i < thread_count; ++i)
+    {
+        Typecheck_Worker *worker = &shared.workers[i];
+        zero_struct(worker);
+        worker->shared = &shared;
+        worker->index = i;
+        pthread_mutex_init(&worker->deque_lock, nullptr);
+        init_job_chunk_pool(&worker->deque_chunks);
+        init_job_queue(&worker->deque, &worker->deque_chunks);
+        init_job_chunk_pool(&worker->job_chunks);
+        init_job_queue(&worker->retry_jobs, &worker->job_chunks);
+        init_job_queue(&worker->deferred_bodies, &worker->job_chunks);
+        pool_init(&worker->ast_pool, 4096);
+        pool_init(&worker->parked_pool, 4096);
+        
+        worker->ctx.ast_pool = &worker->ast_pool;
+        worker->ctx.atom_table = atom_table;
+        worker->ctx.type_table = &type_table;
+        worker->ctx.waiting_jobs = &worker->retry_jobs;
+        worker->ctx.deferred_bodies = &worker->deferred_bodies;
+        worker->ctx.worker = worker;
+        worker->ctx.unchecked_decls = unchecked_decls;
+        worker->ctx.stats = stats ? &worker->stats : nullptr;
+        worker->ctx.success = true;
+    }
+    
+    defer {
+        for(u64 i = 0; i < thread_count; ++i)
+        {
+            Typecheck_Worker *worker = &shared.workers[i];
+            pthread_mutex_destroy(&worker->deque_lock);
+            free_job_chunk_pool(&worker->deque_chunks);
+            free_job_chunk_pool(&worker->job_chunks);
+            pool_adopt(ast_pool, &worker->ast_pool);
+            pool_release(&worker->parked_pool);
+            for(u64 j = 0; j < worker->diagnostics.count; ++j)
+            {
+                mem_dealloc(worker->diagnostics[j].text.data, worker->diagnostics[j].text.count);
+            }
+            array_free(&worker->diagnostics);
+        }
+        mem_dealloc(shared.workers, thread_count);
+        mem_dealloc(shared.wait_lists, shared.wait_list_count);
+        for(u64 i = 0; i < WAIT_LOCK_COUNT; ++i)
+        {
+            pthread_mutex_destroy(&shared.wait_locks[i]);
+        }
+        pthread_barrier_destroy(&shared.barrier);
+        free_type_table(&type_table);
+    };
+    
+    // Note: each worker starts with a contiguous run of the declarations, in reverse, so that it
+    // pops them in source order
+    for(u64 i = 0; i < thread_count; ++i)
+    {
+        u64 begin = decls.count * i / thread_count;
+        u64 end = decls.count * (i + 1) / thread_count;
+        Job batch[JOB_BATCH_SIZE];
+        u64 count = 0;
+        for(u64 j = end; j > begin; --j)
+        {
+            batch[count++] = make_typecheck_job(nullptr, decls[j - 1]);
+            if(count == JOB_BATCH_SIZE || j - 1 == begin)
+            {
+                push_typecheck_jobs(&shared.workers[i], batch, count);
+                count = 0;
+            }
+        }
+    }
+    
+    for(u64 i = 1; i < thread_count; ++i)
+    {
+        pthread_create(&shared.workers[i].thread, nullptr, typecheck_worker_main, &shared.workers[i]);
+    }
+    typecheck_worker_main(&shared.workers[0]);
+    for(u64 i = 1; i < thread_count; ++i)
+    {
+        pthread_join(shared.workers[i].thread, nullptr);
+    }
+    
+    Dynamic_Array<Diagnostic> diagnostics = {0};
+    bool success = true;
+    for(u64 i = 0; i < thread_count; ++i)
+    {
+        Typecheck_Worker *worker = &shared.workers[i];
+        for(u64 j = 0; j < worker->diagnostics.count; ++j)
+        {
+            array_add(&diagnostics, worker->diagnostics[j]);
+        }
+        success = success && worker->ctx.success;
+        if(stats)
+        {
+            add_typecheck_stats(stats, &worker->stats);
+        }
+    }
+    if(stats)
+    {
+        stats->round_count += shared.round;
+    }
+    print_diagnostics(diagnostics.array);
+    array_free(&diagnostics);
+    
+    if(!success)
+    {
+        print_err("Success flag was unset\n");
+        return false;
+    }
+    if(shared.stalled)
+    {
+        Dynamic_Array<Stalled_Job> stalled = {0};
+        add_stalled_jobs(&shared, &stalled);
+        report_stalled_jobs(&type_table, &stalled);
+        array_free(&stalled);
+        return false;
+    }
+    return true;
+}
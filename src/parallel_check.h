@@ -0,0 +1,92 @@
+#ifndef PARALLEL_CHECK_H
+#define PARALLEL_CHECK_H
+
+#include "ast.h"
+#include "basic.h"
+#include "check.h"
+#include "job_queue.h"
+#include "pool_allocator.h"
+#include <pthread.h>
+#include <sched.h>
+
+// Note: typechecks on several threads, each with a deque of ready jobs. A worker runs the jobs at
+// the back of its own deque, and when that is empty, steals from the front of another's.
+// A job that waits for a node is parked in a table shared by all workers, indexed by serial, and
+// is pushed to the deque of whichever worker resolves the node.
+// Jobs that yield without waiting for a node are retried in rounds, like on one thread, and the
+// workers meet at a barrier between rounds.
+
+struct Shared_Parked_Job
+{
+    Job job;
+    Expr_AST *node;
+    Shared_Parked_Job *next;
+};
+
+// Note: the parked lists are guarded by a lock chosen by serial
+constexpr u64 WAIT_LOCK_COUNT = 64;
+// Note: the most jobs gathered on the stack to be pushed at once
+constexpr u64 JOB_BATCH_SIZE = 64;
+
+struct Parallel_Typecheck;
+
+// Note: padded, so that workers don't share cache lines
+struct alignas(64) Typecheck_Worker
+{
+    Context ctx;
+    Parallel_Typecheck *shared;
+    u64 index;
+    pthread_t thread;
+    
+    // Note: the owner pushes and pops at the back, other workers steal from the front. The deque
+    // has chunks of its own, since they are given back by whichever worker empties them
+    pthread_mutex_t deque_lock;
+    Job_Chunk_Pool deque_chunks;
+    Job_Queue deque;
+    
+    // Note: only used by the owner, and between rounds
+    Job_Chunk_Pool job_chunks;
+    Job_Queue retry_jobs;
+    Job_Queue deferred_bodies;
+    // Note: the types made while typechecking, adopted by the compilation's pool at the end
+    Pool_Allocator ast_pool;
+    Pool_Allocator parked_pool;
+    Dynamic_Array<Diagnostic> diagnostics;
+    // Note: added to the caller's stats at the end, if those are being collected
+    Typecheck_Stats stats;
+    bool change;
+};
+
+struct Parallel_Typecheck
+{
+    Typecheck_Worker *workers;
+    u64 worker_count;
+    
+    // Note: indexed by AST serial, a stack of the jobs parked on each node
+    Shared_Parked_Job **wait_lists;
+    u64 wait_list_count;
+    pthread_mutex_t wait_locks[WAIT_LOCK_COUNT];
+    
+    // Note: jobs that were pushed, but are not done yet. A round is over when this reaches 0
+    u64 pending;
+    u64 parked_count;
+    pthread_barrier_t barrier;
+    
+    u64 round;
+    bool stalled;
+    bool done;
+};
+
+// Note: takes the lock of the deque once for all the jobs
+void push_typecheck_jobs(Typecheck_Worker *worker, Job *jobs, u64 count);
+// Note: like push_typecheck_jobs, but jobs scheduled while the declarations are seeded wait for
+// the next round, like on one thread
+void schedule_shared_jobs(Typecheck_Worker *worker, Job *jobs, u64 count);
+// Note: called by set_resolved_type, after resolved_type is stored
+void publish_resolved_type(Typecheck_Worker *worker, Expr_AST *expr);
+// Note: expr must be a node that existed when typechecking started
+void park_shared_job(Typecheck_Worker *worker, Expr_AST *expr, Job job);
+
+bool typecheck_all_parallel(Pool_Allocator *ast_pool, Atom_Table *atom_table, Array<Decl_AST*> decls, u64 thread_count, Typecheck_Stats *stats, Unchecked_Decls *unchecked_decls);
+
+#endif // PARALLEL_CHECK_H
@@ -4,6 +4,7 @@ void init_parsing_context(Parsing_Context *ctx, String program_text, Array<Token
     ctx->program_text = program_text;
     ctx->tokens = tokens;
     ctx->ast_pool = ast_pool;
+    ctx->decl_spans = nullptr;
 }
 
 void report_error(Parsing_Context *ctx, Token *start_section, Token *current,const byte *error_text)
@@ -322,7 +323,10 @@ internal Expr_AST* parse_expr(Parsing_Context *ctx, Token **current_ptr, u32 pre
             {
                 ++current;
                 
-                Dynamic_Array<Expr_AST*> args = {0};
+                Small_Array<Expr_AST*, 8> args = {0};
+                defer {
+                    array_free(&args);
+                };
                 
                 if(current->type != Token_Type::eof && current->type != Token_Type::close_paren)
                 {
@@ -369,7 +373,6 @@ internal Expr_AST* parse_expr(Parsing_Context *ctx, Token **current_ptr, u32 pre
                     call_ast->args[i] = args[i];
                 }
                 
-                // TODO memory leak
                 lhs = call_ast;
                 
                 continue;
@@ -492,7 +495,21 @@ internal Expr_AST *parse_base_expr(Parsing_Context *ctx, Token **current_ptr, u3
             u32 line_offset = current->line_offset;
             
             ++current;
-            Dynamic_Array<Decl_AST*> values = {0};
+            Small_Array<Decl_AST*, 16> values = {0};
+            defer {
+                array_free(&values);
+            };
+            
+            // Note: enum u8 { ... }
+            Expr_AST *underlying_type = nullptr;
+            if(current->type != Token_Type::open_brace)
+            {
+                underlying_type = parse_expr(ctx, &current);
+                if(!underlying_type)
+                {
+                    return nullptr;
+                }
+            }
             
             if(current->type != Token_Type::open_brace)
             {
@@ -523,6 +540,8 @@ internal Expr_AST *parse_base_expr(Parsing_Context *ctx, Token **current_ptr, u3
             enum_ast->resolved_type = nullptr;
             enum_ast->values.count = values.count;
             enum_ast->values.data = pool_alloc(Decl_AST*, values.count, ctx->ast_pool);
+            enum_ast->underlying_type = underlying_type;
+            zero_struct(&enum_ast->table);
             for(u64 i = 0; i < values.count; ++i)
             {
                 enum_ast->values[i] = values[i];
@@ -534,7 +553,10 @@ internal Expr_AST *parse_base_expr(Parsing_Context *ctx, Token **current_ptr, u3
             u32 line_offset = current->line_offset;
             
             ++current;
-            Dynamic_Array<Decl_AST*> decls = {0};
+            Small_Array<Decl_AST*, 16> decls = {0};
+            defer {
+                array_free(&decls);
+            };
             
             if(current->type != Token_Type::open_brace)
             {
@@ -579,6 +601,7 @@ internal Expr_AST *parse_base_expr(Parsing_Context *ctx, Token **current_ptr, u3
             struct_ast->fields.count = var_count;
             struct_ast->constants.data = pool_alloc(Decl_AST*, const_count, ctx->ast_pool);
             struct_ast->fields.data = pool_alloc(Decl_AST*, var_count, ctx->ast_pool);
+            zero_struct(&struct_ast->layout);
             
             u64 const_i = 0;
             u64 var_i = 0;
@@ -605,7 +628,10 @@ internal Expr_AST *parse_base_expr(Parsing_Context *ctx, Token **current_ptr, u3
             
             ++current;
             
-            Dynamic_Array<Parameter_AST> parameters = {0};
+            Small_Array<Parameter_AST, 8> parameters = {0};
+            defer {
+                array_free(&parameters);
+            };
             
             bool expect_more = (current->type != Token_Type::eof && current->type != Token_Type::close_paren);
             bool must_be_func = current->type == Token_Type::close_paren;
@@ -702,7 +728,6 @@ internal Expr_AST *parse_base_expr(Parsing_Context *ctx, Token **current_ptr, u3
             else
             {
                 // It was just a parenthesized expression
-                // TODO: fix memory leak
                 assert(parameters.count == 1);
                 assert(parameters[0].name == nullptr);
                 assert(parameters[0].type != nullptr);
@@ -1356,8 +1381,10 @@ internal Block_AST *parse_statement_block(Parsing_Context *ctx, Token **current_
         result = construct_ast(ctx->ast_pool, Block_AST, current->line_number, current->line_offset);
         ++current;
         
-        // TODO: memory leak
-        Dynamic_Array<AST*> statements = {0};
+        Small_Array<AST*, 16> statements = {0};
+        defer {
+            array_free(&statements);
+        };
         
         while(true)
         {
@@ -1548,6 +1575,13 @@ Dynamic_Array<Decl_AST*> parse_tokens(Parsing_Context *ctx)
         if(decl)
         {
             array_add(&result, decl);
+            if(ctx->decl_spans)
+            {
+                Token_Span span;
+                span.first = (u32)(start_section - ctx->tokens.data);
+                span.count = (u32)(current - start_section);
+                array_add(ctx->decl_spans, span);
+            }
         }
         else
         {
@@ -7,11 +7,20 @@
 #include "lex.h"
 #include "pool_allocator.h"
 
+// Note: the tokens of a top-level declaration, from its identifier to its semicolon
+struct Token_Span
+{
+    u32 first;
+    u32 count;
+};
+
 struct Parsing_Context
 {
     String program_text;
     Array<Token> tokens;
     Pool_Allocator *ast_pool;
+    // Note: if set, parse_tokens adds the tokens of each declaration it returns, in the same order
+    Dynamic_Array<Token_Span> *decl_spans;
 };
 
 void init_parsing_context(Parsing_Context *ctx, String program_text, Array<Token> tokens, Pool_Allocator *ast_pool);
@@ -1,6 +1,46 @@
 
 #include <sys/mman.h>
 
+// Note: the guard page mode replaces the memory pattern fill for pools
+#if defined(USE_DEBUG_MEMORY_PATTERN) && !defined(USE_DEBUG_GUARD_PAGES)
+#define USE_POOL_MEMORY_PATTERN
+#endif
+
+#ifdef USE_DEBUG_GUARD_PAGES
+// Note: in guard page mode, a block is laid out as [header page][data pages][guard page]
+// The guard page is always PROT_NONE. pool_reset makes the data pages PROT_NONE as well,
+// until the block is handed out again. Allocations of at least a page get a block of
+// their own, placed so they end against the guard page.
+constexpr u64 POOL_PAGE_SIZE = 4096;
+constexpr u64 POOL_GUARD_MIN_BLOCK_SIZE = 16 * POOL_PAGE_SIZE;
+
+internal inline
+u64 round_up_to_page(u64 size)
+{
+    return (size + POOL_PAGE_SIZE - 1) & ~(POOL_PAGE_SIZE - 1);
+}
+#endif
+
+internal inline
+byte *block_start(Block_Header *block)
+{
+#ifdef USE_DEBUG_GUARD_PAGES
+    return (byte*)block + POOL_PAGE_SIZE;
+#else
+    return block->memory;
+#endif
+}
+
+internal inline
+byte *block_end(Block_Header *block)
+{
+#ifdef USE_DEBUG_GUARD_PAGES
+    return (byte*)block + block->size - POOL_PAGE_SIZE;
+#else
+    return (byte*)block + block->size;
+#endif
+}
+
 void pool_init(Pool_Allocator *pool, u64 block_size)
 {
     zero_struct(pool);
@@ -16,13 +56,11 @@ void *pool_alloc_func(void *data, Allocator_Mode mode, void *old_ptr, u64 old_si
     }
     else if(mode == Allocator_Mode::resize)
     {
-        // return pool_resize_(pool, old_ptr, old_size, new_size);
-        return nullptr;
+        return pool_resize_(pool, old_ptr, old_size, new_size);
     }
     else if(mode == Allocator_Mode::dealloc)
     {
-        // TODO: perhaps deallocate if the allocation was the most recent?
-        assert(false);
+        pool_dealloc_(pool, old_ptr, old_size);
         return nullptr;
     }
     
@@ -30,9 +68,21 @@ void *pool_alloc_func(void *data, Allocator_Mode mode, void *old_ptr, u64 old_si
     return nullptr;
 }
 
+Allocator pool_allocator(Pool_Allocator *pool)
+{
+    Allocator result;
+    result.function = pool_alloc_func;
+    result.data = pool;
+    return result;
+}
+
 internal
 Block_Header* allocate_block(u64 block_size)
 {
+#ifdef USE_DEBUG_GUARD_PAGES
+    u64 data_size = round_up_to_page(block_size - sizeof(Block_Header));
+    block_size = POOL_PAGE_SIZE + data_size + POOL_PAGE_SIZE;
+#endif
     // TODO: try out allocating large pages?
     print_err("INFO: allocating block\n");
     void *memory = mmap(nullptr, block_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
@@ -45,7 +95,10 @@ Block_Header* allocate_block(u64 block_size)
         Block_Header *result = static_cast<Block_Header*>(memory);
         result->next = nullptr;
         result->size = block_size;
-#ifdef USE_DEBUG_MEMORY_PATTERN
+#ifdef USE_DEBUG_GUARD_PAGES
+        mprotect(block_end(result), POOL_PAGE_SIZE, PROT_NONE);
+#endif
+#ifdef USE_POOL_MEMORY_PATTERN
         byte *start = result->memory;
         u64 size = block_size - sizeof(Block_Header);
         fill_memory(start, MEMORY_PATTERN, size);
@@ -54,6 +107,36 @@ Block_Header* allocate_block(u64 block_size)
     }
 }
 
+#ifdef USE_DEBUG_GUARD_PAGES
+internal
+void poison_block(Block_Header *block)
+{
+    byte *start = block_start(block);
+    u64 size = block_end(block) - start;
+    // Note: dropping the pages keeps poisoned blocks from costing resident memory
+    madvise(start, size, MADV_DONTNEED);
+    mprotect(start, size, PROT_NONE);
+}
+
+internal
+void unpoison_block(Block_Header *block)
+{
+    byte *start = block_start(block);
+    u64 size = block_end(block) - start;
+    mprotect(start, size, PROT_READ | PROT_WRITE);
+}
+
+internal
+void poison_blocks(Block_Header *block)
+{
+    while(block)
+    {
+        poison_block(block);
+        block = block->next;
+    }
+}
+#endif
+
 internal
 void deallocate_blocks(Block_Header *block)
 {
@@ -72,7 +155,7 @@ Block_Header* pool_get_block(Pool_Allocator *pool, u64 min_size)
     {
         Block_Header *prev_block = nullptr;
         Block_Header *block = pool->free_blocks;
-        while(block && block->size < min_size)
+        while(block && (u64)(block_end(block) - block_start(block)) + sizeof(Block_Header) < min_size)
         {
             prev_block = block;
             block = block->next;
@@ -89,6 +172,9 @@ Block_Header* pool_get_block(Pool_Allocator *pool, u64 min_size)
             }
             
             block->next = nullptr;
+#ifdef USE_DEBUG_GUARD_PAGES
+            unpoison_block(block);
+#endif
             return block;
         }
     }
@@ -97,51 +183,93 @@ Block_Header* pool_get_block(Pool_Allocator *pool, u64 min_size)
     {
         alloc_size = pool->new_block_size;
     }
+#ifdef USE_DEBUG_GUARD_PAGES
+    // Note: every block costs several mappings in this mode, so keep them from being tiny
+    if(alloc_size < POOL_GUARD_MIN_BLOCK_SIZE)
+    {
+        alloc_size = POOL_GUARD_MIN_BLOCK_SIZE;
+    }
+#endif
     return allocate_block(alloc_size);
 }
 
+internal inline
+byte *align_pointer(byte *ptr, u64 alignment)
+{
+    uintptr_t unaligned = (uintptr_t)ptr;
+    return (byte*)((unaligned + (alignment - 1)) & ~(uintptr_t)(alignment - 1));
+}
+
 // TODO: let the pool take from free blocks
 void *pool_alloc_(Pool_Allocator *pool, u64 size)
 {
+    return pool_alloc_aligned_(pool, size, POOL_MIN_ALIGNMENT);
+}
+
+void *pool_alloc_aligned_(Pool_Allocator *pool, u64 size, u64 alignment)
+{
+    assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    assert(alignment <= POOL_MAX_ALIGNMENT);
+    if(alignment < POOL_MIN_ALIGNMENT)
+    {
+        alignment = POOL_MIN_ALIGNMENT;
+    }
+    
+#ifdef USE_DEBUG_GUARD_PAGES
+    if(size >= POOL_PAGE_SIZE)
+    {
+        // Note: the end can only be up to (alignment - 1) bytes short of the guard page
+        Block_Header *block = allocate_block(size + sizeof(Block_Header));
+        assert(block);
+        block->next = pool->used_blocks;
+        pool->used_blocks = block;
+        pool->mark += size;
+        
+        uintptr_t unaligned = (uintptr_t)(block_end(block) - size);
+        return (void*)(unaligned & ~(uintptr_t)(alignment - 1));
+    }
+#endif
+    
     if(!pool->current_block)
     {
         assert(pool->new_block_size > 0);
         
         Block_Header *block = pool_get_block(pool, 0);
         pool->current_block = block;
-        pool->current_point = block->memory;
-        pool->current_end = block->memory - sizeof(Block_Header) + block->size;
+        pool->current_point = block_start(block);
+        pool->current_end = block_end(block);
     }
     
     assert(pool->current_block && pool->current_point && pool->current_end);
     
-    u64 available_space = pool->current_end - pool->current_point;
+    byte *result = align_pointer(pool->current_point, alignment);
     
-    if(size > available_space)
+    if(result > pool->current_end || size > (u64)(pool->current_end - result))
     {
         // Retire the old block
+        u64 available_space = pool->current_end - pool->current_point;
         pool->current_block->next = pool->used_blocks;
         pool->used_blocks = pool->current_block;
         pool->mark += available_space;
         
         // Get a new block
-        u64 min_size = size + sizeof(Block_Header);
+        // Note: the block memory is only POOL_MIN_ALIGNMENT aligned, so leave room for padding
+        u64 min_size = size + sizeof(Block_Header) + (alignment - POOL_MIN_ALIGNMENT);
         
         Block_Header *block = pool_get_block(pool, min_size);
         pool->current_block = block;
-        pool->current_point = block->memory;
-        pool->current_end = block->memory - sizeof(Block_Header) + block->size;
+        pool->current_point = block_start(block);
+        pool->current_end = block_end(block);
         
-        available_space = pool->current_end - pool->current_point;
+        result = align_pointer(pool->current_point, alignment);
     }
     
-    assert(size <= available_space);
+    assert(result <= pool->current_end && size <= (u64)(pool->current_end - result));
     
-    byte *result = pool->current_point;
-    uintptr_t unaligned_point = (uintptr_t)(pool->current_point + size);
-    pool->current_point = (byte*)((unaligned_point + 7) & (~7));
+    byte *start = pool->current_point;
+    pool->current_point = align_pointer(result + size, POOL_MIN_ALIGNMENT);
     
-    pool->mark += (pool->current_point - result);
+    pool->mark += (pool->current_point - start);
     
     return (void*)result;
 }
@@ -149,8 +277,7 @@ void *pool_alloc_(Pool_Allocator *pool, u64 size)
 void *pool_resize_(Pool_Allocator *pool, void *old_ptr, u64 old_size, u64 new_size)
 {
     byte *old_memory = (byte*)old_ptr;
-    uintptr_t unaligned_point = (uintptr_t)(old_memory + old_size);
-    byte *old_end = (byte*)((unaligned_point + 7) & (~7));
+    byte *old_end = align_pointer(old_memory + old_size, POOL_MIN_ALIGNMENT);
     if(old_end == pool->current_point)
     {
         u64 real_old_size = old_end - old_memory;
@@ -161,7 +288,7 @@ void *pool_resize_(Pool_Allocator *pool, void *old_ptr, u64 old_size, u64 new_si
         if(new_memory != old_memory)
         {
             copy_memory(new_memory, old_memory, old_size);
-#ifdef USE_DEBUG_MEMORY_PATTERN
+#ifdef USE_POOL_MEMORY_PATTERN
             fill_memory(old_memory, MEMORY_PATTERN, old_size);
 #endif
         }
@@ -179,6 +306,20 @@ void *pool_resize_(Pool_Allocator *pool, void *old_ptr, u64 old_size, u64 new_si
     }
 }
 
+void pool_dealloc_(Pool_Allocator *pool, void *old_ptr, u64 old_size)
+{
+    byte *old_memory = (byte*)old_ptr;
+    byte *old_end = align_pointer(old_memory + old_size, POOL_MIN_ALIGNMENT);
+    if(old_memory && old_end == pool->current_point)
+    {
+        pool->current_point = old_memory;
+        pool->mark -= old_end - old_memory;
+#ifdef USE_POOL_MEMORY_PATTERN
+        fill_memory(old_memory, MEMORY_PATTERN, old_size);
+#endif
+    }
+}
+
 #if 0
 // Note: if we don't need this, we could probably save in fragmentation (not sure how much) by retiring the block with smallest waste instead of always retiring in order
 void pool_rewind(Pool_Allocator *pool, u64 mark)
@@ -220,12 +361,72 @@ void pool_rewind(Pool_Allocator *pool, u64 mark)
 }
 #endif
 
+internal
+Block_Header *append_blocks(Block_Header *blocks, Block_Header *list)
+{
+    if(!blocks)
+    {
+        return list;
+    }
+    Block_Header *block = blocks;
+    while(block->next)
+    {
+        block = block->next;
+    }
+    block->next = list;
+    return blocks;
+}
+
+void pool_adopt(Pool_Allocator *pool, Pool_Allocator *from)
+{
+    // Note: the rest of from's current block is not used by pool, just like a retired block
+    if(from->current_block)
+    {
+        from->current_block->next = from->used_blocks;
+        from->used_blocks = from->current_block;
+    }
+    pool->used_blocks = append_blocks(from->used_blocks, pool->used_blocks);
+    pool->free_blocks = append_blocks(from->free_blocks, pool->free_blocks);
+    pool->mark += from->mark;
+    
+    from->current_block = nullptr;
+    from->current_point = nullptr;
+    from->current_end = nullptr;
+    from->used_blocks = nullptr;
+    from->free_blocks = nullptr;
+    from->mark = 0;
+}
+
 void pool_reset(Pool_Allocator *pool)
 {
+#ifdef USE_DEBUG_GUARD_PAGES
+    // Note: the current block is retired as well, so that all of it gets poisoned
+    if(pool->current_block)
+    {
+        pool->current_block->next = pool->used_blocks;
+        pool->used_blocks = pool->current_block;
+        pool->current_block = nullptr;
+        pool->current_point = nullptr;
+        pool->current_end = nullptr;
+    }
+    if(pool->used_blocks)
+    {
+        poison_blocks(pool->used_blocks);
+        
+        Block_Header *block = pool->used_blocks;
+        while(block->next)
+        {
+            block = block->next;
+        }
+        block->next = pool->free_blocks;
+        pool->free_blocks = pool->used_blocks;
+        pool->used_blocks = nullptr;
+    }
+#else
     if(pool->current_block)
     {
-        pool->current_point = pool->current_block->memory;
-#ifdef USE_DEBUG_MEMORY_PATTERN
+        pool->current_point = block_start(pool->current_block);
+#ifdef USE_POOL_MEMORY_PATTERN
         u64 size = pool->current_end - pool->current_point;
         fill_memory(pool->current_point, MEMORY_PATTERN, size);
 #endif
@@ -236,13 +437,13 @@ void pool_reset(Pool_Allocator *pool)
         
         while(block->next)
         {
-#ifdef USE_DEBUG_MEMORY_PATTERN
+#ifdef USE_POOL_MEMORY_PATTERN
             u64 size = block->size - sizeof(Block_Header);
             fill_memory(block->memory, MEMORY_PATTERN, size);
 #endif
             block = block->next;
         }
-#ifdef USE_DEBUG_MEMORY_PATTERN
+#ifdef USE_POOL_MEMORY_PATTERN
         u64 size = block->size - sizeof(Block_Header);
         fill_memory(block->memory, MEMORY_PATTERN, size);
 #endif
@@ -250,6 +451,7 @@ void pool_reset(Pool_Allocator *pool)
         pool->free_blocks = pool->used_blocks;
         pool->used_blocks = nullptr;
     }
+#endif
     pool->mark = 0;
 }
 
@@ -1,6 +1,9 @@
 #ifndef POOL_ALLOCATOR_H
 #define POOL_ALLOCATOR_H
 
+constexpr u64 POOL_MIN_ALIGNMENT = 8;
+constexpr u64 POOL_MAX_ALIGNMENT = 4096;
+
 struct Block_Header
 {
     Block_Header *next;
@@ -28,15 +31,35 @@ GET_MACRO(__VA_ARGS__,dummy,pool_alloc3,pool_alloc2)(__VA_ARGS__)
 pool_alloc3(type,1,pool)
 #define pool_alloc3(type,n,pool) \
 ((type*)pool_alloc_((pool),(n)*sizeof(type)))
+// Note: alignment must be a power of two, at most POOL_MAX_ALIGNMENT (one page)
+// Every allocation is at least POOL_MIN_ALIGNMENT aligned
+#define pool_alloc_aligned(...) \
+GET_MACRO(__VA_ARGS__,pool_alloc_aligned4,pool_alloc_aligned3,pool_alloc_aligned2)(__VA_ARGS__)
+
+#define pool_alloc_aligned2(type,pool) \
+pool_alloc_aligned4(type,1,alignof(type),pool)
+#define pool_alloc_aligned3(type,n,pool) \
+pool_alloc_aligned4(type,n,alignof(type),pool)
+#define pool_alloc_aligned4(type,n,alignment,pool) \
+((type*)pool_alloc_aligned_((pool),(n)*sizeof(type),(alignment)))
 #define pool_resize(old_ptr,old_n,new_n,pool) \
 ((decltype(old_ptr))pool_resize_((pool),(old_ptr), (old_n)*sizeof(decltype(*(old_ptr))), (new_n)*sizeof(decltype(*(old_ptr)))))
 
 void pool_init(Pool_Allocator *pool, u64 block_size);
 
 void *pool_alloc_func(void *data, Allocator_Mode mode, void *old_ptr, u64 old_size, u64 new_size);
+Allocator pool_allocator(Pool_Allocator *pool);
 
 void *pool_alloc_(Pool_Allocator *pool, u64 size);
+void *pool_alloc_aligned_(Pool_Allocator *pool, u64 size, u64 alignment);
 void *pool_resize_(Pool_Allocator *pool, void *old_ptr, u64 old_size, u64 new_size);
+// Note: only gives the memory back if it is the most recent allocation,
+// anything else stays allocated until pool_reset
+void pool_dealloc_(Pool_Allocator *pool, void *old_ptr, u64 old_size);
+
+// Note: moves all blocks of from into pool, so what was allocated from from lives as long as
+// pool's own allocations. from is left empty, and can be used again.
+void pool_adopt(Pool_Allocator *pool, Pool_Allocator *from);
 
 void pool_reset(Pool_Allocator *pool);
 void pool_release(Pool_Allocator *pool);
@@ -1,3 +1,5 @@
+#include <sys/random.h>
+
 
 u64 fnv1a_64(String s)
 {
@@ -14,32 +16,213 @@ u64 fnv1a_64(String s)
     return hash;
 }
 
+u64 string_hash_seed = 0x2d358dccaa6c78a5UL;
+
+internal inline
+u64 hash_read8(byte *p)
+{
+    u64 result;
+    copy_memory_(&result, p, 8);
+    return result;
+}
+
+internal inline
+u64 hash_read4(byte *p)
+{
+    u32 result;
+    copy_memory_(&result, p, 4);
+    return result;
+}
+
+// Note: 1 to 3 bytes, reads the first, middle and last byte
+internal inline
+u64 hash_read3(byte *p, u64 count)
+{
+    return ((u64)(u8)p[0] << 16) | ((u64)(u8)p[count >> 1] << 8) | (u64)(u8)p[count - 1];
+}
+
+internal inline
+void hash_multiply(u64 *a, u64 *b)
+{
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (u64)r;
+    *b = (u64)(r >> 64);
+}
+
+internal inline
+u64 hash_mix(u64 a, u64 b)
+{
+    hash_multiply(&a, &b);
+    return a ^ b;
+}
+
+u64 hash_string(String s, u64 seed)
+{
+    const u64 p0 = 0xa0761d6478bd642fUL;
+    const u64 p1 = 0xe7037ed1a0b428dbUL;
+    const u64 p2 = 0x8ebc6af09c88c6e3UL;
+    const u64 p3 = 0x589965cc75374cc3UL;
+    
+    byte *p = s.data;
+    u64 count = s.count;
+    u64 a, b;
+    
+    if(count <= 16)
+    {
+        if(count >= 4)
+        {
+            // Note: two (possibly overlapping) 4 byte reads from each end
+            u64 offset = (count >> 3) << 2;
+            a = (hash_read4(p) << 32) | hash_read4(p + offset);
+            b = (hash_read4(p + count - 4) << 32) | hash_read4(p + count - 4 - offset);
+        }
+        else if(count > 0)
+        {
+            a = hash_read3(p, count);
+            b = 0;
+        }
+        else
+        {
+            a = 0;
+            b = 0;
+        }
+    }
+    else
+    {
+        u64 i = count;
+        if(i > 48)
+        {
+            u64 seed1 = seed;
+            u64 seed2 = seed;
+            do
+            {
+                seed = hash_mix(hash_read8(p) ^ p1, hash_read8(p + 8) ^ seed);
+                seed1 = hash_mix(hash_read8(p + 16) ^ p2, hash_read8(p + 24) ^ seed1);
+                seed2 = hash_mix(hash_read8(p + 32) ^ p3, hash_read8(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            }
+            while(i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while(i > 16)
+        {
+            seed = hash_mix(hash_read8(p) ^ p1, hash_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        // Note: the last 16 bytes, overlapping with what was already hashed
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
+    
+    a ^= p1;
+    b ^= seed;
+    hash_multiply(&a, &b);
+    return hash_mix(a ^ p0 ^ count, b ^ p1);
+}
+
+u64 hash_string(String s)
+{
+    return hash_string(s, string_hash_seed);
+}
+
+void randomize_string_hash_seed()
+{
+    u64 seed;
+    if(getrandom(&seed, sizeof(seed), 0) != sizeof(seed))
+    {
+        seed = read_tsc();
+    }
+    string_hash_seed = seed;
+}
+
 u64 compute_hash64(Atom a) {
-    u64 x = (u64)a.str;
-    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
-    x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
-    x = x ^ (x >> 31);
+    // Note: ids are small and dense, spread them over the high bits and fold back down
+    u64 x = (u64)a.id * 0x9e3779b97f4a7c15UL;
+    x = x ^ (x >> 29);
     return x;
 }
 
-void init_hashed_scope(Hashed_Scope *hs, Hashed_Scope *parent_scope, u64 index_in_parent, u64 initial_size)
+void init_hashed_scope(Hashed_Scope *hs, Hashed_Scope *parent_scope, u64 index_in_parent, Allocator a)
 {
     hs->parent_scope = parent_scope;
-    hs->index_in_parent = index_in_parent;
-    init_hash_set(&hs->entry_set, initial_size);
+    hs->index_in_parent = (u32)index_in_parent;
+    hs->inline_count = 0;
+    init_hash_set(&hs->entry_set, 0, a);
+}
+
+internal inline
+bool scope_is_inline(Hashed_Scope *hs)
+{
+    return hs->entry_set.set_size == 0;
+}
+
+// Note: returns the inline slot holding key, or SCOPE_INLINE_COUNT
+internal inline
+u32 scope_find_inline(Hashed_Scope *hs, Atom key)
+{
+    static_assert(SCOPE_INLINE_COUNT == 4, "the inline keys are compared as one 16 byte vector");
+#ifdef __SSE2__
+    __m128i keys = _mm_loadu_si128((__m128i*)hs->inline_keys);
+    __m128i match = _mm_cmpeq_epi32(keys, _mm_set1_epi32((s32)key.id));
+    u32 matches = (u32)_mm_movemask_ps(_mm_castsi128_ps(match));
+#else
+    u32 matches = 0;
+    for(u32 i = 0; i < SCOPE_INLINE_COUNT; ++i)
+    {
+        matches |= (u32)(hs->inline_keys[i] == key) << i;
+    }
+#endif
+    matches &= (1u << hs->inline_count) - 1;
+    return matches ? __builtin_ctz(matches) : SCOPE_INLINE_COUNT;
 }
 
 bool scope_insert(Hashed_Scope *hs, Scope_Entry entry)
 {
-    return set_insert(&hs->entry_set, entry);
+    return scope_insert(hs, entry, compute_hash64(entry.key));
 }
 bool scope_insert(Hashed_Scope *hs, Scope_Entry entry, u64 hash)
 {
+    if(scope_is_inline(hs))
+    {
+        if(scope_find_inline(hs, entry.key) < SCOPE_INLINE_COUNT)
+        {
+            return false;
+        }
+        
+        if(hs->inline_count < SCOPE_INLINE_COUNT)
+        {
+            u32 i = hs->inline_count;
+            hs->inline_keys[i] = entry.key;
+            hs->inline_indices[i] = entry.index;
+            hs->inline_definitions[i] = entry.definition;
+            ++hs->inline_count;
+            return true;
+        }
+        
+        scope_resize(hs, HASH_GROUP_SIZE);
+    }
     return set_insert(&hs->entry_set, entry, hash);
 }
 void scope_resize(Hashed_Scope *hs, u64 new_size)
 {
-    set_resize(&hs->entry_set, new_size);
+    if(scope_is_inline(hs))
+    {
+        init_hash_set(&hs->entry_set, new_size, hs->entry_set.allocator);
+        for(u32 i = 0; i < hs->inline_count; ++i)
+        {
+            Scope_Entry entry;
+            entry.key = hs->inline_keys[i];
+            entry.index = hs->inline_indices[i];
+            entry.definition = hs->inline_definitions[i];
+            set_insert(&hs->entry_set, entry);
+        }
+    }
+    else
+    {
+        set_resize(&hs->entry_set, new_size);
+    }
 }
 Expr_AST *scope_find(Hashed_Scope *hs, Atom key, u64 scope_index, bool recurse)
 {
@@ -50,55 +233,344 @@ Expr_AST *scope_find(Hashed_Scope *hs, Atom key, u64 scope_index, u64 hash, bool
 {
     do
     {
-        Scope_Entry *entry = set_find(&hs->entry_set, key, hash);
-        if(entry && scope_index >= entry->index)
+        if(scope_is_inline(hs))
         {
-            return entry->definition;
+            u32 i = scope_find_inline(hs, key);
+            if(i < SCOPE_INLINE_COUNT && scope_index >= hs->inline_indices[i])
+            {
+                return hs->inline_definitions[i];
+            }
         }
         else
         {
-            scope_index = hs->index_in_parent;
-            hs = hs->parent_scope;
+            Scope_Entry *entry = set_find(&hs->entry_set, key, hash);
+            if(entry && scope_index >= entry->index)
+            {
+                return entry->definition;
+            }
         }
+        
+        scope_index = hs->index_in_parent;
+        hs = hs->parent_scope;
     }
     while(hs && recurse);
     return nullptr;
 }
 
+u64 scope_probe_count(Hashed_Scope *hs, Atom key, u64 scope_index)
+{
+    u64 hash = compute_hash64(key);
+    u64 probes = 0;
+    do
+    {
+        if(scope_is_inline(hs))
+        {
+            ++probes;
+            u32 i = scope_find_inline(hs, key);
+            if(i < SCOPE_INLINE_COUNT && scope_index >= hs->inline_indices[i])
+            {
+                return probes;
+            }
+        }
+        else
+        {
+            probes += set_probe_count(&hs->entry_set, key, hash);
+            Scope_Entry *entry = set_find(&hs->entry_set, key, hash);
+            if(entry && scope_index >= entry->index)
+            {
+                return probes;
+            }
+        }
+        
+        scope_index = hs->index_in_parent;
+        hs = hs->parent_scope;
+    }
+    while(hs);
+    return probes;
+}
+
+internal
+u32 round_up_pow2(u64 n)
+{
+    u32 result = 1;
+    while(result < n)
+    {
+        result *= 2;
+    }
+    return result;
+}
+
+void init_member_index(Member_Index *mi, Array<Member_Slot> members, Allocator a)
+{
+    u32 count = (u32)members.count;
+    u32 bucket_count = round_up_pow2(count / 2);
+    u32 slot_count = round_up_pow2(count);
+    
+    // Note: group the members by bucket, so each bucket can be placed at once
+    u32 *bucket_starts = mem_alloc(u32, bucket_count + 1);
+    u32 *bucket_members = mem_alloc(u32, count);
+    defer {
+        mem_dealloc(bucket_starts, bucket_count + 1);
+        mem_dealloc(bucket_members, count);
+    };
+    zero_memory(bucket_starts, bucket_count + 1);
+    
+    u32 max_bucket_size = 0;
+    for(u32 i = 0; i < count; ++i)
+    {
+        u32 b = (compute_hash64(members[i].atom) >> 40) & (bucket_count - 1);
+        ++bucket_starts[b + 1];
+        max_bucket_size = max(max_bucket_size, bucket_starts[b + 1]);
+    }
+    for(u32 b = 0; b < bucket_count; ++b)
+    {
+        bucket_starts[b + 1] += bucket_starts[b];
+    }
+    // Note: uses the starts as cursors, which moves each one to the start of the next bucket
+    for(u32 i = 0; i < count; ++i)
+    {
+        u32 b = (compute_hash64(members[i].atom) >> 40) & (bucket_count - 1);
+        bucket_members[bucket_starts[b]++] = i;
+    }
+    for(u32 b = bucket_count; b > 0; --b)
+    {
+        bucket_starts[b] = bucket_starts[b - 1];
+    }
+    bucket_starts[0] = 0;
+    
+    mi->bucket_mask = bucket_count - 1;
+    mi->displacements = mem_alloc(u32, bucket_count, a);
+    mi->slots = nullptr;
+    
+    while(true)
+    {
+        mi->slot_mask = slot_count - 1;
+        mi->slots = mem_alloc(Member_Slot, slot_count, a);
+        for(u32 i = 0; i < slot_count; ++i)
+        {
+            mi->slots[i].atom.id = (u32)-1;
+            mi->slots[i].member = MEMBER_NOT_FOUND;
+        }
+        zero_memory(mi->displacements, bucket_count);
+        
+        // Note: the biggest buckets are placed first, while there is the most room
+        bool placed_all = true;
+        for(u32 size = max_bucket_size; size > 0 && placed_all; --size)
+        {
+            for(u32 b = 0; b < bucket_count && placed_all; ++b)
+            {
+                u32 start = bucket_starts[b];
+                if(bucket_starts[b + 1] - start != size)
+                {
+                    continue;
+                }
+                
+                // Note: the step is odd, so each name goes through every slot as the
+                // displacement goes up to slot_count
+                bool placed = false;
+                for(u32 d = 0; d < slot_count && !placed; ++d)
+                {
+                    u32 i = 0;
+                    for(; i < size; ++i)
+                    {
+                        Member_Slot member = members[bucket_members[start + i]];
+                        u32 slot = member_index_slot(mi, compute_hash64(member.atom), d);
+                        if(mi->slots[slot].member != MEMBER_NOT_FOUND)
+                        {
+                            break;
+                        }
+                        mi->slots[slot] = member;
+                    }
+                    if(i == size)
+                    {
+                        mi->displacements[b] = d;
+                        placed = true;
+                    }
+                    else
+                    {
+                        while(i > 0)
+                        {
+                            --i;
+                            Member_Slot member = members[bucket_members[start + i]];
+                            u32 slot = member_index_slot(mi, compute_hash64(member.atom), d);
+                            mi->slots[slot].atom.id = (u32)-1;
+                            mi->slots[slot].member = MEMBER_NOT_FOUND;
+                        }
+                    }
+                }
+                placed_all = placed;
+            }
+        }
+        
+        if(placed_all)
+        {
+            return;
+        }
+        mem_dealloc(mi->slots, slot_count, a);
+        slot_count *= 2;
+    }
+}
+
 void init_atom_table(Atom_Table *at, u64 initial_set_size, u64 block_size)
 {
     init_hash_set(&at->atom_set, initial_set_size);
+    at->strings = {0};
+    array_resize(&at->strings, initial_set_size);
     pool_init(&at->atom_pool, block_size);
 }
 
+void reset_atom_table(Atom_Table *at)
+{
+    clear_hash_set(&at->atom_set);
+    at->strings.count = 0;
+    pool_reset(&at->atom_pool);
+}
+
+void free_atom_table(Atom_Table *at)
+{
+    free_hash_set(&at->atom_set);
+    array_free(&at->strings);
+    pool_release(&at->atom_pool);
+}
+
 Atom atomize_string(Atom_Table *at, String str)
 {
-    u64 hash = fnv1a_64(str);
+    u64 hash = set_hash(&at->atom_set, str);
     
     u64 slot = set_find_slot(&at->atom_set, str, hash);
-    if(at->atom_set.hashes[slot] == 0)
+    if(set_slot_empty(&at->atom_set, slot))
     {
-        String *new_str = pool_alloc(String, &at->atom_pool);
-        assert(new_str);
-        new_str->count = str.count;
-        new_str->data = pool_alloc(byte, str.count, &at->atom_pool);
-        copy_memory(new_str->data, str.data, str.count);
+        assert(at->strings.count < (u32)-1);
         
-        Atom result = {new_str};
-        set_insert_into_slot(&at->atom_set, slot, hash, result);
+        Atom_Entry entry;
+        entry.str.count = str.count;
+        entry.str.data = pool_alloc(byte, str.count, &at->atom_pool);
+        copy_memory(entry.str.data, str.data, str.count);
+        entry.atom.id = (u32)at->strings.count;
         
-        return result;
+        array_add(&at->strings, entry.str);
+        set_insert_into_slot(&at->atom_set, slot, hash, entry);
+        
+        return entry.atom;
     }
     else
     {
-        return at->atom_set.entries[slot];
+        return set_slot_entry(&at->atom_set, slot)->atom;
     }
 }
 
 
 
+void init_scoping_context(Scoping_Context *ctx, Atom_Table *atom_table, Pool_Allocator *ast_pool)
+{
+    ctx->atom_table = atom_table;
+    ctx->ast_pool = ast_pool;
+    ctx->bindings = {0};
+    ctx->undo_log = {0};
+    ctx->forward_references = {0};
+    ctx->decl_references = nullptr;
+    ctx->file_scope = nullptr;
+    ctx->decl_index = 0;
+    ctx->in_function_body = false;
+    ctx->success = true;
+}
+
 internal
-void create_scope_metadata(Scoping_Context *ctx, Function_AST *func, u64 type, Hashed_Scope *scope, u64 scope_index, AST *ast)
+Hashed_Scope *make_scope(Scoping_Context *ctx, Hashed_Scope *parent_scope, u64 index_in_parent)
+{
+    Hashed_Scope *result = pool_alloc(Hashed_Scope, ctx->ast_pool);
+    init_hashed_scope(result, parent_scope, index_in_parent, pool_allocator(ctx->ast_pool));
+    return result;
+}
+
+internal
+Atom atomize_ident(Scoping_Context *ctx, Ident_AST *ident_ast, u64 type, Hashed_Scope *scope, u64 scope_index)
+{
+    Atom atom = atomize_string(ctx->atom_table, ident_ast->ident);
+    while(ctx->bindings.count <= atom.id)
+    {
+        array_add(&ctx->bindings, (Expr_AST*)nullptr);
+    }
+    
+    ident_ast->atom = atom;
+    ident_ast->tagged_expr_ptr = type; // need to know this
+    ident_ast->scope_index = (u32)scope_index;
+    ident_ast->scope = scope;
+    return atom;
+}
+
+// Note: inserts the atomized name into scope, and makes it visible until the scope is left
+internal
+void bind_ident(Scoping_Context *ctx, Hashed_Scope *scope, u64 scope_index, Ident_AST *ident_ast)
+{
+    Atom atom = ident_ast->atom;
+    Scope_Entry entry;
+    entry.key = atom;
+    entry.index = (u32)scope_index;
+    entry.definition = ident_ast;
+    bool success = scope_insert(scope, entry);
+    if(!success)
+    {
+        // TODO: better error reporting
+        Expr_AST *prev = scope_find(scope, atom, scope_index);
+        assert(prev);
+        String str = atom_string(ctx->atom_table, atom);
+        print_err("Error: %d:%d: Redeclared identifier '%.*s'\nPrevious declaration at %d:%d\n", ident_ast->line_number, ident_ast->line_offset, str.count, str.data, prev->line_number, prev->line_offset);
+        ctx->success = false;
+        return;
+    }
+    
+    Binding_Undo undo;
+    undo.atom = atom;
+    undo.previous = ctx->bindings[atom.id];
+    array_add(&ctx->undo_log, undo);
+    ctx->bindings[atom.id] = ident_ast;
+}
+
+internal
+void declare_ident(Scoping_Context *ctx, u64 type, Hashed_Scope *scope, u64 scope_index, Ident_AST *ident_ast)
+{
+    if(!ident_ast)
+    {
+        return;
+    }
+    
+    atomize_ident(ctx, ident_ast, type, scope, scope_index);
+    bind_ident(ctx, scope, scope_index, ident_ast);
+}
+
+// Note: records that the declaration being walked refers to definition, if that is another
+// top-level declaration
+internal
+void add_decl_reference(Scoping_Context *ctx, u32 decl_index, bool from_body, Expr_AST *definition)
+{
+    Ident_AST *ident_ast = static_cast<Ident_AST*>(definition);
+    if(ctx->decl_references && ident_ast->scope == ctx->file_scope)
+    {
+        Decl_Reference reference;
+        reference.decl_index = decl_index;
+        reference.atom = ident_ast->atom;
+        reference.from_body = from_body;
+        array_add(ctx->decl_references, reference);
+    }
+}
+
+internal
+void leave_scope(Scoping_Context *ctx, u64 undo_count)
+{
+    while(ctx->undo_log.count > undo_count)
+    {
+        Binding_Undo undo = ctx->undo_log[--ctx->undo_log.count];
+        ctx->bindings[undo.atom.id] = undo.previous;
+    }
+}
+
+// Note: the names of a scope are declared by whatever creates it, before anything in the scope is
+// visited, except in a block or the file scope, where a declaration is bound from its own
+// statement on. So when a reference is visited, the bindings hold what scope_find would return
+// for it, unless it refers to something further down in the file scope.
+internal
+void create_scope_metadata(Scoping_Context *ctx, Function_AST *func, Hashed_Scope *scope, u64 scope_index, AST *ast)
 {
     if(!ast)
     {
@@ -108,128 +580,148 @@ void create_scope_metadata(Scoping_Context *ctx, Function_AST *func, u64 type, H
     switch(ast->type)
     {
         case AST_Type::decl_ast: {
+            // Note: the identifier was declared by the enclosing scope
             Decl_AST *decl_ast = static_cast<Decl_AST*>(ast);
-            create_scope_metadata(ctx, func, IDENT_DECL, scope, scope_index, &decl_ast->ident);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, decl_ast->decl_type);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, decl_ast->expr);
+            create_scope_metadata(ctx, func, scope, scope_index, decl_ast->decl_type);
+            create_scope_metadata(ctx, func, scope, scope_index, decl_ast->expr);
         } break;
         case AST_Type::block_ast: {
             Block_AST *block_ast = static_cast<Block_AST*>(ast);
+            u64 undo_count = ctx->undo_log.count;
             
-            Hashed_Scope *block_scope = pool_alloc(Hashed_Scope, ctx->ast_pool);
-            init_hashed_scope(block_scope, scope, scope_index, 8);
+            // Note: the block scope is only created at the first declaration, anything before it
+            // can't see the declarations in the block anyway, so it uses the outer scope directly
+            Hashed_Scope *block_scope = nullptr;
             
             for(u64 i = 0; i < block_ast->statements.count; ++i)
             {
-                create_scope_metadata(ctx, func, IDENT_REFERENCE, block_scope, i, block_ast->statements[i]);
+                AST *statement = block_ast->statements[i];
+                if(statement->type == AST_Type::decl_ast)
+                {
+                    if(!block_scope)
+                    {
+                        block_scope = make_scope(ctx, scope, scope_index);
+                    }
+                    declare_ident(ctx, IDENT_DECL, block_scope, i, &static_cast<Decl_AST*>(statement)->ident);
+                }
+                
+                if(block_scope)
+                {
+                    create_scope_metadata(ctx, func, block_scope, i, statement);
+                }
+                else
+                {
+                    create_scope_metadata(ctx, func, scope, scope_index, statement);
+                }
             }
+            leave_scope(ctx, undo_count);
         } break;
         case AST_Type::while_ast: {
             While_AST *while_ast = static_cast<While_AST*>(ast);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, while_ast->guard);
-            create_scope_metadata(ctx, func, IDENT_DECL, scope, scope_index, while_ast->body);
+            create_scope_metadata(ctx, func, scope, scope_index, while_ast->guard);
+            create_scope_metadata(ctx, func, scope, scope_index, while_ast->body);
         } break;
         case AST_Type::for_ast: {
             For_AST *for_ast = static_cast<For_AST*>(ast);
             
-            Hashed_Scope *for_scope = pool_alloc(Hashed_Scope, ctx->ast_pool);
-            init_hashed_scope(for_scope, scope, scope_index, 4);
-            
-            create_scope_metadata(ctx, func, IDENT_LOOP_VAR, for_scope, 0, for_ast->induction_var);
-            
             if(for_ast->flags & FOR_FLAG_OVER_ARRAY)
             {
-                create_scope_metadata(ctx, func, IDENT_LOOP_VAR, for_scope, 0, for_ast->index_var);
-                create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, for_ast->array_expr);
+                create_scope_metadata(ctx, func, scope, scope_index, for_ast->array_expr);
             }
             else
             {
-                create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, for_ast->low_expr);
-                create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, for_ast->high_expr);
+                create_scope_metadata(ctx, func, scope, scope_index, for_ast->low_expr);
+                create_scope_metadata(ctx, func, scope, scope_index, for_ast->high_expr);
             }
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, for_scope, 1, for_ast->body);
+            
+            u64 undo_count = ctx->undo_log.count;
+            Hashed_Scope *for_scope = make_scope(ctx, scope, scope_index);
+            
+            declare_ident(ctx, IDENT_LOOP_VAR, for_scope, 0, for_ast->induction_var);
+            if(for_ast->flags & FOR_FLAG_OVER_ARRAY)
+            {
+                declare_ident(ctx, IDENT_LOOP_VAR, for_scope, 0, for_ast->index_var);
+            }
+            create_scope_metadata(ctx, func, for_scope, 1, for_ast->body);
+            leave_scope(ctx, undo_count);
         } break;
         case AST_Type::if_ast: {
             If_AST *if_ast = static_cast<If_AST*>(ast);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, if_ast->guard);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, if_ast->then_block);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, if_ast->else_block);
+            create_scope_metadata(ctx, func, scope, scope_index, if_ast->guard);
+            create_scope_metadata(ctx, func, scope, scope_index, if_ast->then_block);
+            create_scope_metadata(ctx, func, scope, scope_index, if_ast->else_block);
         } break;
         case AST_Type::assign_ast: {
             Assign_AST *assign_ast = static_cast<Assign_AST*>(ast);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, assign_ast->lhs);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, assign_ast->rhs);
+            create_scope_metadata(ctx, func, scope, scope_index, assign_ast->lhs);
+            create_scope_metadata(ctx, func, scope, scope_index, assign_ast->rhs);
         } break;
         case AST_Type::return_ast: {
             Return_AST *return_ast = static_cast<Return_AST*>(ast);
             return_ast->function = func;
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, return_ast->expr);
+            create_scope_metadata(ctx, func, scope, scope_index, return_ast->expr);
         } break;
         case AST_Type::ident_ast: {
+            // Note: only references get here, declarations go through declare_ident
             Ident_AST *ident_ast = static_cast<Ident_AST*>(ast);
             
-            String str = ident_ast->ident;
-            Atom atom = atomize_string(ctx->atom_table, str);
-            
-            ident_ast->atom = atom;
-            ident_ast->tagged_expr_ptr = type; // need to know this
-            ident_ast->scope_index = scope_index;
-            ident_ast->scope = scope;
+            Atom atom = atomize_ident(ctx, ident_ast, IDENT_REFERENCE, scope, scope_index);
             
-            if(type != IDENT_REFERENCE)
+            Expr_AST *definition = ctx->bindings[atom.id];
+            if(definition)
             {
-                Scope_Entry entry;
-                entry.key = atom;
-                entry.index = scope_index;
-                entry.definition = ident_ast;
-                bool success = scope_insert(scope, entry);
-                if(!success)
-                {
-                    // TODO: better error reporting
-                    Expr_AST *prev = scope_find(scope, atom, scope_index);
-                    assert(prev);
-                    print_err("Error: %d:%d: Redeclared identifier '%.*s'\nPrevious declaration at %d:%d\n", ident_ast->line_number, ident_ast->line_offset, str.count, str.data, prev->line_number, prev->line_offset);
-                    ctx->success = false;
-                }
+                ident_set_expr(ident_ast, definition);
+                add_decl_reference(ctx, ctx->decl_index, ctx->in_function_body, definition);
+            }
+            else
+            {
+                Forward_Reference reference;
+                reference.ident = ident_ast;
+                reference.decl_index = ctx->decl_index;
+                reference.from_body = ctx->in_function_body;
+                array_add(&ctx->forward_references, reference);
             }
         } break;
         case AST_Type::function_type_ast: {
             Function_Type_AST *function_type_ast = static_cast<Function_Type_AST*>(ast);
             for(u64 i = 0; i < function_type_ast->parameter_types.count; ++i)
             {
-                create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, function_type_ast->parameter_types[i]);
+                create_scope_metadata(ctx, func, scope, scope_index, function_type_ast->parameter_types[i]);
             }
             for(u64 i = 0; i < function_type_ast->return_types.count; ++i)
             {
-                create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, function_type_ast->return_types[i]);
+                create_scope_metadata(ctx, func, scope, scope_index, function_type_ast->return_types[i]);
             }
         } break;
         case AST_Type::function_ast: {
             Function_AST *function_ast = static_cast<Function_AST*>(ast);
+            u64 undo_count = ctx->undo_log.count;
             
-            Hashed_Scope *func_scope = pool_alloc(Hashed_Scope, ctx->ast_pool);
-            init_hashed_scope(func_scope, scope, scope_index, 8);
-            
-            create_scope_metadata(ctx, function_ast, IDENT_REFERENCE, func_scope, 0, function_ast->prototype);
+            Hashed_Scope *func_scope = make_scope(ctx, scope, scope_index);
             
             for(u64 i = 0; i < function_ast->param_names.count; ++i)
             {
-                create_scope_metadata(ctx, function_ast, IDENT_PARAM, func_scope, 0, function_ast->param_names[i]);
+                declare_ident(ctx, IDENT_PARAM, func_scope, 0, function_ast->param_names[i]);
             }
+            create_scope_metadata(ctx, function_ast, func_scope, 0, function_ast->prototype);
             for(u64 i = 0; i < function_ast->default_values.count; ++i)
             {
-                create_scope_metadata(ctx, function_ast, IDENT_REFERENCE, func_scope, 1, function_ast->default_values[i]);
+                create_scope_metadata(ctx, function_ast, func_scope, 1, function_ast->default_values[i]);
             }
-            create_scope_metadata(ctx, function_ast, IDENT_REFERENCE, func_scope, 2, function_ast->block);
+            bool in_function_body = ctx->in_function_body;
+            ctx->in_function_body = true;
+            create_scope_metadata(ctx, function_ast, func_scope, 2, function_ast->block);
+            ctx->in_function_body = in_function_body;
+            leave_scope(ctx, undo_count);
         } break;
         case AST_Type::function_call_ast: {
             Function_Call_AST *function_call_ast = static_cast<Function_Call_AST*>(ast);
             
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, function_call_ast->function);
+            create_scope_metadata(ctx, func, scope, scope_index, function_call_ast->function);
             
             for(u64 i = 0; i < function_call_ast->args.count; ++i)
             {
-                create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, function_call_ast->args[i]);
+                create_scope_metadata(ctx, func, scope, scope_index, function_call_ast->args[i]);
             }
         } break;
         case AST_Type::access_ast: {
@@ -238,49 +730,102 @@ void create_scope_metadata(Scoping_Context *ctx, Function_AST *func, u64 type, H
             String str = access_ast->ident;
             Atom atom = atomize_string(ctx->atom_table, str);
             access_ast->atom = atom;
+            access_ast->field_index = ACCESS_NOT_FIELD;
             access_ast->expr = nullptr;
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, access_ast->lhs);
+            access_ast->field_offset = 0;
+            create_scope_metadata(ctx, func, scope, scope_index, access_ast->lhs);
         } break;
         case AST_Type::binary_operator_ast: {
             Binary_Operator_AST *binop_ast = static_cast<Binary_Operator_AST*>(ast);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, binop_ast->lhs);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, binop_ast->rhs);
+            create_scope_metadata(ctx, func, scope, scope_index, binop_ast->lhs);
+            create_scope_metadata(ctx, func, scope, scope_index, binop_ast->rhs);
         } break;
         case AST_Type::enum_ast: {
             Enum_AST *enum_ast = static_cast<Enum_AST*>(ast);
+            create_scope_metadata(ctx, func, scope, scope_index, enum_ast->underlying_type);
             
-            Hashed_Scope *values_scope = pool_alloc(Hashed_Scope, ctx->ast_pool);
-            init_hashed_scope(values_scope, scope, scope_index, 8);
+            u64 undo_count = ctx->undo_log.count;
+            Hashed_Scope *values_scope = make_scope(ctx, scope, scope_index);
             
             for(u64 i = 0; i < enum_ast->values.count; ++i)
             {
                 // TODO: is IDENT_DECL best for this?
-                create_scope_metadata(ctx, func, IDENT_REFERENCE, values_scope, 0, enum_ast->values[i]);
+                declare_ident(ctx, IDENT_DECL, values_scope, 0, &enum_ast->values[i]->ident);
+            }
+            for(u64 i = 0; i < enum_ast->values.count; ++i)
+            {
+                create_scope_metadata(ctx, func, values_scope, 0, enum_ast->values[i]);
+            }
+            leave_scope(ctx, undo_count);
+            
+            // Note: the names must be distinct, which they aren't after a redeclaration
+            if(ctx->success)
+            {
+                Array<Member_Slot> members;
+                members.count = enum_ast->values.count;
+                members.data = mem_alloc(Member_Slot, members.count);
+                for(u64 i = 0; i < enum_ast->values.count; ++i)
+                {
+                    members[i] = {enum_ast->values[i]->ident.atom, (u32)i};
+                }
+                init_member_index(&enum_ast->member_index, members, pool_allocator(ctx->ast_pool));
+                mem_dealloc(members.data, members.count);
             }
             enum_ast->scope = values_scope;
         } break;
         case AST_Type::struct_ast: {
             Struct_AST *struct_ast = static_cast<Struct_AST*>(ast);
+            u64 undo_count = ctx->undo_log.count;
             
-            Hashed_Scope *constants_scope = pool_alloc(Hashed_Scope, ctx->ast_pool);
-            init_hashed_scope(constants_scope, scope, scope_index, 8);
-            Hashed_Scope *fields_scope = pool_alloc(Hashed_Scope, ctx->ast_pool);
-            init_hashed_scope(fields_scope, constants_scope, 0, 8);
+            Hashed_Scope *constants_scope = make_scope(ctx, scope, scope_index);
+            Hashed_Scope *fields_scope = make_scope(ctx, constants_scope, 0);
             
+            // Note: the fields scope is inside the constants scope, so the constants can't see the fields
             for(u64 i = 0; i < struct_ast->constants.count; ++i)
             {
-                create_scope_metadata(ctx, func, IDENT_DECL, constants_scope, 0, struct_ast->constants[i]);
+                declare_ident(ctx, IDENT_DECL, constants_scope, 0, &struct_ast->constants[i]->ident);
+            }
+            for(u64 i = 0; i < struct_ast->constants.count; ++i)
+            {
+                create_scope_metadata(ctx, func, constants_scope, 0, struct_ast->constants[i]);
             }
             for(u64 i = 0; i < struct_ast->fields.count; ++i)
             {
-                create_scope_metadata(ctx, func, IDENT_FIELD, fields_scope, 0, struct_ast->fields[i]);
+                declare_ident(ctx, IDENT_DECL, fields_scope, 0, &struct_ast->fields[i]->ident);
+            }
+            for(u64 i = 0; i < struct_ast->fields.count; ++i)
+            {
+                create_scope_metadata(ctx, func, fields_scope, 0, struct_ast->fields[i]);
+            }
+            leave_scope(ctx, undo_count);
+            
+            // Note: the names must be distinct, which they aren't after a redeclaration
+            if(ctx->success)
+            {
+                Array<Member_Slot> members;
+                members.count = 0;
+                members.data = mem_alloc(Member_Slot, struct_ast->constants.count + struct_ast->fields.count);
+                for(u64 i = 0; i < struct_ast->constants.count; ++i)
+                {
+                    members.data[members.count++] = {struct_ast->constants[i]->ident.atom, (u32)i};
+                }
+                for(u64 i = 0; i < struct_ast->fields.count; ++i)
+                {
+                    Atom atom = struct_ast->fields[i]->ident.atom;
+                    if(!scope_find(constants_scope, atom, 0, false))
+                    {
+                        members.data[members.count++] = {atom, (u32)(struct_ast->constants.count + i)};
+                    }
+                }
+                init_member_index(&struct_ast->member_index, members, pool_allocator(ctx->ast_pool));
+                mem_dealloc(members.data, struct_ast->constants.count + struct_ast->fields.count);
             }
             struct_ast->constant_scope = constants_scope;
             struct_ast->field_scope = fields_scope;
         } break;
         case AST_Type::unary_ast: {
             Unary_Operator_AST *unop_ast = static_cast<Unary_Operator_AST*>(ast);
-            create_scope_metadata(ctx, func, IDENT_REFERENCE, scope, scope_index, unop_ast->operand);
+            create_scope_metadata(ctx, func, scope, scope_index, unop_ast->operand);
         } break;
         case AST_Type::number_ast:
         case AST_Type::primitive_ast:
@@ -291,16 +836,55 @@ void create_scope_metadata(Scoping_Context *ctx, Function_AST *func, u64 type, H
     }
 }
 
-bool create_scope_metadata(Scoping_Context *ctx, Array<Decl_AST*> decls)
+bool create_scope_metadata(Scoping_Context *ctx, Array<Decl_AST*> decls, Array<bool> already_scoped)
 {
     ctx->success = true;
+    defer {
+        array_free(&ctx->bindings);
+        array_free(&ctx->undo_log);
+        array_free(&ctx->forward_references);
+    };
     
-    Hashed_Scope *file_scope = pool_alloc(Hashed_Scope, ctx->ast_pool);
-    init_hashed_scope(file_scope, nullptr, 0, 16);
+    Hashed_Scope *file_scope = make_scope(ctx, nullptr, 0);
+    ctx->file_scope = file_scope;
     
     for(u64 i = 0; i < decls.count; ++i)
     {
-        create_scope_metadata(ctx, nullptr, IDENT_DECL, file_scope, 0, decls[i]);
+        if(already_scoped.count && already_scoped[i])
+        {
+            // Note: the ident keeps its atom and its definition from the typechecker
+            Ident_AST *ident_ast = &decls[i]->ident;
+            while(ctx->bindings.count <= ident_ast->atom.id)
+            {
+                array_add(&ctx->bindings, (Expr_AST*)nullptr);
+            }
+            ident_ast->scope = file_scope;
+            bind_ident(ctx, file_scope, 0, ident_ast);
+            continue;
+        }
+        ctx->decl_index = (u32)i;
+        declare_ident(ctx, IDENT_DECL, file_scope, 0, &decls[i]->ident);
+        create_scope_metadata(ctx, nullptr, file_scope, 0, decls[i]);
+    }
+    
+    // Note: every other scope declares its names before they can be referenced, so these can
+    // only be declared further down in the file scope
+    for(u64 i = 0; i < ctx->forward_references.count; ++i)
+    {
+        Forward_Reference *reference = &ctx->forward_references[i];
+        Ident_AST *ident_ast = reference->ident;
+        Expr_AST *definition = scope_find(file_scope, ident_ast->atom, 0, false);
+        if(definition)
+        {
+            ident_set_expr(ident_ast, definition);
+            add_decl_reference(ctx, reference->decl_index, reference->from_body, definition);
+        }
+        else
+        {
+            String str = atom_string(ctx->atom_table, ident_ast->atom);
+            print_err("Error: %d:%d: Undeclared identifier \"%.*s\"\n", ident_ast->line_number, ident_ast->line_offset, str.count, str.data);
+            ctx->success = false;
+        }
     }
     return ctx->success;
 }
@@ -3,20 +3,51 @@
 
 #include "basic.h"
 #include "pool_allocator.h"
+#include <stddef.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Note: slots are stored in groups of HASH_GROUP_SIZE, each group holds one control byte per
+// slot followed by the entries of those slots. A control byte is either HASH_CTRL_EMPTY,
+// HASH_CTRL_SENTINEL (a slot that does not exist, when the set is smaller than a group),
+// or the low 7 bits of the hash of the entry in that slot.
+// Probing looks at a whole group at once, so a lookup usually only compares the key of the
+// entry it is looking for.
+constexpr u64 HASH_GROUP_SIZE = 16;
+constexpr u8 HASH_CTRL_EMPTY = 0x80;
+constexpr u8 HASH_CTRL_SENTINEL = 0xFF;
+
+template<typename T>
+struct Hash_Group
+{
+    u8 ctrl[HASH_GROUP_SIZE];
+    T entries[HASH_GROUP_SIZE];
+};
 
-// TODO: support custom allocator?
 // Note: K==Key, GK==get_key, H==hash, Eq==equality
+// set_size must be a power of 2
+// The control bytes and entries are one allocation from allocator, which is also used to
+// grow the set. With a pool allocator, the old memory is only reclaimed by resetting the pool.
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 struct Hash_Set
 {
     u64 set_size;
     u64 count;
-    u64 *hashes;
-    T *entries;
+    Hash_Group<T> *groups;
+    Allocator allocator;
 };
 
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
-void init_hash_set(Hash_Set<T,K,GK,H,Eq> *hs, u64 initial_size = 0);
+void init_hash_set(Hash_Set<T,K,GK,H,Eq> *hs, u64 initial_size = 0, Allocator a = default_allocator);
+
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+void free_hash_set(Hash_Set<T,K,GK,H,Eq> *hs);
+
+// Note: removes all entries, but keeps the table memory
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+void clear_hash_set(Hash_Set<T,K,GK,H,Eq> *hs);
 
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 bool set_insert(Hash_Set<T,K,GK,H,Eq> *hs, T entry);
@@ -27,95 +58,266 @@ bool set_insert(Hash_Set<T,K,GK,H,Eq> *hs, T entry, u64 hash);
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 void set_resize(Hash_Set<T,K,GK,H,Eq> *hs, u64 new_size);
 
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+u64 set_hash(Hash_Set<T,K,GK,H,Eq> *hs, K key);
+
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 T *set_find(Hash_Set<T,K,GK,H,Eq> *hs, K key);
 
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 T *set_find(Hash_Set<T,K,GK,H,Eq> *hs, K key, u64 hash);
 
+// Note: returns the slot holding key, or the empty slot where it would be inserted
+// The set must not be empty
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 u64 set_find_slot(Hash_Set<T,K,GK,H,Eq> *hs, K key);
 
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 u64 set_find_slot(Hash_Set<T,K,GK,H,Eq> *hs, K key, u64 hash);
 
+// Note: the number of groups a lookup of key looks at, for benchmarks
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
-void set_insert_into_slot(Hash_Set<T,K,GK,H,Eq> *hs, u64 slot, u64 hash, T entry);
+u64 set_probe_count(Hash_Set<T,K,GK,H,Eq> *hs, K key, u64 hash);
 
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+bool set_slot_empty(Hash_Set<T,K,GK,H,Eq> *hs, u64 slot);
+
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+T *set_slot_entry(Hash_Set<T,K,GK,H,Eq> *hs, u64 slot);
 
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+void set_insert_into_slot(Hash_Set<T,K,GK,H,Eq> *hs, u64 slot, u64 hash, T entry);
 
+
+// Note: atoms are numbered densely from 0, in the order they are first seen,
+// so they can be used to index arrays
 struct Atom
 {
-    String *str;
+    u32 id;
 };
 
 inline
-bool operator==(Atom a1, Atom a2) { return a1.str == a2.str; }
-inline
-String get_str(Atom &a) { return *a.str; }
+bool operator==(Atom a1, Atom a2) { return a1.id == a2.id; }
 u64 fnv1a_64(String s);
 u64 compute_hash64(Atom a);
 
+// Note: reads the string 8 or 16 bytes at a time (after wyhash), with a separate path for
+// strings up to 16 bytes, which is what most identifiers are
+u64 hash_string(String s, u64 seed);
+u64 hash_string(String s);
+
+// Note: a fixed value by default, so that runs are reproducible
+// Must only be changed before any table is filled
+extern u64 string_hash_seed;
+void randomize_string_hash_seed();
+
+struct Atom_Entry
+{
+    String str;
+    Atom atom;
+};
+
+inline
+String get_str(Atom_Entry &entry) { return entry.str; }
+
 struct Atom_Table
 {
-    Hash_Set<Atom,String,get_str,fnv1a_64,operator==> atom_set;
+    // Note: swap the hash function here to compare e.g. with fnv1a_64
+    Hash_Set<Atom_Entry,String,get_str,hash_string,operator==> atom_set;
+    // Note: indexed by atom id, the characters live in atom_pool
+    Dynamic_Array<String> strings;
     Pool_Allocator atom_pool;
 };
 
 void init_atom_table(Atom_Table *at, u64 initial_set_size, u64 block_size);
+void reset_atom_table(Atom_Table *at);
+void free_atom_table(Atom_Table *at);
 Atom atomize_string(Atom_Table *at, String str);
 
+inline
+String atom_string(Atom_Table *at, Atom atom)
+{
+    return at->strings[atom.id];
+}
+
 
 
 struct Expr_AST;
+struct Ident_AST;
 struct Scope_Entry
 {
     Atom key;
-    u64 index;
+    u32 index;
     Expr_AST *definition;
 };
 
 inline
 Atom get_key(Scope_Entry &entry) { return entry.key; }
 
+// Note: most scopes only hold a few names, so the first SCOPE_INLINE_COUNT entries are kept
+// in the scope itself, and searched all at once. Inserting past that moves all entries to
+// entry_set, which is only allocated then.
+constexpr u64 SCOPE_INLINE_COUNT = 4;
+
 struct Hashed_Scope
 {
     Hashed_Scope *parent_scope;
-    u64 index_in_parent;
+    u32 index_in_parent;
+    u32 inline_count;
+    Atom inline_keys[SCOPE_INLINE_COUNT];
+    u32 inline_indices[SCOPE_INLINE_COUNT];
+    Expr_AST *inline_definitions[SCOPE_INLINE_COUNT];
     Hash_Set<Scope_Entry,Atom,get_key,compute_hash64,operator==> entry_set;
 };
 
-void init_hashed_scope(Hashed_Scope *hs, Hashed_Scope *parent_scope, u64 index_in_parent, u64 initial_size = 8);
+// Note: a is used for entry_set
+void init_hashed_scope(Hashed_Scope *hs, Hashed_Scope *parent_scope, u64 index_in_parent, Allocator a = default_allocator);
 bool scope_insert(Hashed_Scope *hs, Scope_Entry entry);
 bool scope_insert(Hashed_Scope *hs, Scope_Entry entry, u64 hash);
 void scope_resize(Hashed_Scope *hs, u64 new_size);
 Expr_AST *scope_find(Hashed_Scope *hs, Atom key, u64 scope_index, bool recurse = true);
 Expr_AST *scope_find(Hashed_Scope *hs, Atom key, u64 scope_index, u64 hash, bool recurse = true);
+// Note: the number of inline scopes and hash groups scope_find looks at, for benchmarks
+u64 scope_probe_count(Hashed_Scope *hs, Atom key, u64 scope_index);
+
+
+
+// Note: a perfect hash over the member names of a struct or enum, so finding a member is one
+// hash, one displacement and one compare, and never probes. The names are split into buckets,
+// and each bucket gets a displacement that moves all of its names to free slots
+// ("hash and displace").
+constexpr u32 MEMBER_NOT_FOUND = (u32)-1;
+
+struct Member_Slot
+{
+    Atom atom;
+    u32 member;
+};
+
+struct Member_Index
+{
+    u32 slot_mask;
+    u32 bucket_mask;
+    u32 *displacements;
+    Member_Slot *slots;
+};
+
+// Note: the atoms in members must be distinct
+void init_member_index(Member_Index *mi, Array<Member_Slot> members, Allocator a = default_allocator);
+
+inline
+u32 member_index_slot(Member_Index *mi, u64 hash, u32 displacement)
+{
+    return ((u32)hash + displacement * ((u32)(hash >> 16) | 1)) & mi->slot_mask;
+}
+
+inline
+u32 member_index_find(Member_Index *mi, Atom atom)
+{
+    u64 hash = compute_hash64(atom);
+    u32 displacement = mi->displacements[(hash >> 40) & mi->bucket_mask];
+    Member_Slot *slot = &mi->slots[member_index_slot(mi, hash, displacement)];
+    return (slot->atom == atom) ? slot->member : MEMBER_NOT_FOUND;
+}
+
 
+// Note: bit i of the result is set if ctrl[i] == tag
+inline
+u32 hash_group_match(u8 *ctrl, u8 tag)
+{
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((__m128i*)ctrl);
+    __m128i match = _mm_cmpeq_epi8(group, _mm_set1_epi8((byte)tag));
+    return (u32)_mm_movemask_epi8(match);
+#else
+    u32 result = 0;
+    for(u64 i = 0; i < HASH_GROUP_SIZE; ++i)
+    {
+        result |= (u32)(ctrl[i] == tag) << i;
+    }
+    return result;
+#endif
+}
+
+inline
+u8 hash_ctrl_tag(u64 hash)
+{
+    return (u8)(hash & 0x7F);
+}
 
+// Note: a set smaller than a group only allocates entries for the slots that exist
+template<typename T>
+u64 hash_groups_alloc_size(u64 set_size)
+{
+    if(set_size < HASH_GROUP_SIZE)
+    {
+        return offsetof(Hash_Group<T>, entries) + set_size*sizeof(T);
+    }
+    else
+    {
+        return (set_size / HASH_GROUP_SIZE) * sizeof(Hash_Group<T>);
+    }
+}
+
+template<typename T>
+void hash_groups_clear(Hash_Group<T> *groups, u64 set_size)
+{
+    if(set_size < HASH_GROUP_SIZE)
+    {
+        fill_memory(groups->ctrl, HASH_CTRL_EMPTY, set_size);
+        fill_memory(groups->ctrl + set_size, HASH_CTRL_SENTINEL, HASH_GROUP_SIZE - set_size);
+    }
+    else
+    {
+        for(u64 i = 0; i < set_size / HASH_GROUP_SIZE; ++i)
+        {
+            fill_memory(groups[i].ctrl, HASH_CTRL_EMPTY, HASH_GROUP_SIZE);
+        }
+    }
+}
 
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
-void init_hash_set(Hash_Set<T,K,GK,H,Eq> *hs, u64 initial_size)
+void init_hash_set(Hash_Set<T,K,GK,H,Eq> *hs, u64 initial_size, Allocator a)
 {
+    assert((initial_size & (initial_size - 1)) == 0);
+    
     hs->set_size = initial_size;
     hs->count = 0;
+    hs->allocator = a;
     
     if(initial_size > 0)
     {
-        // TODO: could replace with SOA allocation
-        hs->hashes = mem_alloc(u64, initial_size);
-        hs->entries = mem_alloc(T, initial_size);
-        
-        assert(hs->hashes);
-        assert(hs->entries);
+        hs->groups = (Hash_Group<T>*)mem_alloc(byte, hash_groups_alloc_size<T>(initial_size), a);
+        assert(hs->groups);
         
-        zero_memory(hs->hashes, initial_size);
+        hash_groups_clear(hs->groups, initial_size);
     }
     else
     {
-        hs->hashes = nullptr;
-        hs->entries = nullptr;
+        hs->groups = nullptr;
+    }
+}
+
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+void free_hash_set(Hash_Set<T,K,GK,H,Eq> *hs)
+{
+    if(hs->set_size > 0)
+    {
+        mem_dealloc((byte*)hs->groups, hash_groups_alloc_size<T>(hs->set_size), hs->allocator);
     }
+    hs->set_size = 0;
+    hs->count = 0;
+    hs->groups = nullptr;
+}
+
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+void clear_hash_set(Hash_Set<T,K,GK,H,Eq> *hs)
+{
+    if(hs->set_size > 0)
+    {
+        hash_groups_clear(hs->groups, hs->set_size);
+    }
+    hs->count = 0;
 }
 
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
@@ -127,8 +329,13 @@ bool set_insert(Hash_Set<T,K,GK,H,Eq> *hs, T entry)
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 bool set_insert(Hash_Set<T,K,GK,H,Eq> *hs, T entry, u64 hash)
 {
+    if(hs->set_size == 0)
+    {
+        init_hash_set(hs, HASH_GROUP_SIZE, hs->allocator);
+    }
+    
     u64 slot = set_find_slot(hs, GK(entry), hash);
-    if(hs->hashes[slot] == 0)
+    if(set_slot_empty(hs, slot))
     {
         set_insert_into_slot(hs, slot, hash, entry);
         return true;
@@ -145,21 +352,34 @@ void set_resize(Hash_Set<T,K,GK,H,Eq> *hs, u64 new_size)
     assert(new_size >= hs->count);
     
     u64 old_size = hs->set_size;
-    u64 *old_hashes = hs->hashes;
-    T *old_entries = hs->entries;
+    Hash_Group<T> *old_groups = hs->groups;
     
-    init_hash_set(hs, new_size);
+    init_hash_set(hs, new_size, hs->allocator);
     
-    for(u64 i = 0; i < old_size; ++i)
+    // Note: only 7 bits of each hash are kept, so the hashes are recomputed
+    u64 group_count = (old_size + HASH_GROUP_SIZE - 1) / HASH_GROUP_SIZE;
+    for(u64 i = 0; i < group_count; ++i)
     {
-        if(old_hashes[i] != 0)
+        Hash_Group<T> *group = &old_groups[i];
+        for(u64 j = 0; j < HASH_GROUP_SIZE; ++j)
         {
-            set_insert(hs, old_entries[i], old_hashes[i]);
+            if(!(group->ctrl[j] & HASH_CTRL_EMPTY))
+            {
+                set_insert(hs, group->entries[j]);
+            }
         }
     }
     
-    mem_dealloc(old_hashes, old_size);
-    mem_dealloc(old_entries, old_size);
+    if(old_size > 0)
+    {
+        mem_dealloc((byte*)old_groups, hash_groups_alloc_size<T>(old_size), hs->allocator);
+    }
+}
+
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+u64 set_hash(Hash_Set<T,K,GK,H,Eq> *hs, K key)
+{
+    return H(key);
 }
 
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
@@ -171,14 +391,19 @@ T *set_find(Hash_Set<T,K,GK,H,Eq> *hs, K key)
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 T *set_find(Hash_Set<T,K,GK,H,Eq> *hs, K key, u64 hash)
 {
+    if(hs->set_size == 0)
+    {
+        return nullptr;
+    }
+    
     u64 slot = set_find_slot(hs, key, hash);
-    if(hs->hashes[slot] == 0)
+    if(set_slot_empty(hs, slot))
     {
         return nullptr;
     }
     else
     {
-        return &hs->entries[slot];
+        return set_slot_entry(hs, slot);
     }
 }
 
@@ -191,42 +416,95 @@ u64 set_find_slot(Hash_Set<T,K,GK,H,Eq> *hs, K key)
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 u64 set_find_slot(Hash_Set<T,K,GK,H,Eq> *hs, K key, u64 hash)
 {
-    if(hash == 0)
-    {
-        hash = 1;
-    }
+    assert(hs->set_size > 0);
     
-    u64 mask = hs->set_size - 1;
-    u64 idx = hash & mask;
+    u8 tag = hash_ctrl_tag(hash);
+    u64 mask = (hs->set_size - 1) / HASH_GROUP_SIZE;
+    u64 idx = (hash >> 7) & mask;
     u64 inc = 0;
     
     while(true)
     {
-        if(hs->hashes[idx] == 0)
+        Hash_Group<T> *group = &hs->groups[idx];
+        
+        u32 matches = hash_group_match(group->ctrl, tag);
+        while(matches)
         {
-            return idx;
+            u32 i = __builtin_ctz(matches);
+            if(Eq(GK(group->entries[i]), key))
+            {
+                return idx*HASH_GROUP_SIZE + i;
+            }
+            matches &= matches - 1;
         }
-        else if(hs->hashes[idx] == hash && Eq(GK(hs->entries[idx]), key))
+        
+        // Note: there are no deletions, so the key can't be past an empty slot
+        u32 empty = hash_group_match(group->ctrl, HASH_CTRL_EMPTY);
+        if(empty)
         {
-            return idx;
+            return idx*HASH_GROUP_SIZE + __builtin_ctz(empty);
         }
-        else
+        
+        ++inc;
+        idx = (idx + inc) & mask;
+    }
+}
+
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+u64 set_probe_count(Hash_Set<T,K,GK,H,Eq> *hs, K key, u64 hash)
+{
+    if(hs->set_size == 0)
+    {
+        return 0;
+    }
+    
+    u8 tag = hash_ctrl_tag(hash);
+    u64 mask = (hs->set_size - 1) / HASH_GROUP_SIZE;
+    u64 idx = (hash >> 7) & mask;
+    u64 inc = 0;
+    
+    while(true)
+    {
+        Hash_Group<T> *group = &hs->groups[idx];
+        
+        u32 matches = hash_group_match(group->ctrl, tag);
+        while(matches)
+        {
+            u32 i = __builtin_ctz(matches);
+            if(Eq(GK(group->entries[i]), key))
+            {
+                return inc + 1;
+            }
+            matches &= matches - 1;
+        }
+        if(hash_group_match(group->ctrl, HASH_CTRL_EMPTY))
         {
-            ++inc;
-            idx = (idx + inc) & mask;
+            return inc + 1;
         }
+        
+        ++inc;
+        idx = (idx + inc) & mask;
     }
 }
 
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+bool set_slot_empty(Hash_Set<T,K,GK,H,Eq> *hs, u64 slot)
+{
+    return hs->groups[slot / HASH_GROUP_SIZE].ctrl[slot % HASH_GROUP_SIZE] == HASH_CTRL_EMPTY;
+}
+
+template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
+T *set_slot_entry(Hash_Set<T,K,GK,H,Eq> *hs, u64 slot)
+{
+    return &hs->groups[slot / HASH_GROUP_SIZE].entries[slot % HASH_GROUP_SIZE];
+}
+
 template<typename T, typename K, K (*GK)(T&), u64 (*H)(K), bool (*Eq)(K,K)>
 void set_insert_into_slot(Hash_Set<T,K,GK,H,Eq> *hs, u64 slot, u64 hash, T entry)
 {
-    if(hash == 0)
-    {
-        hash = 1;
-    }
-    hs->hashes[slot] = hash;
-    hs->entries[slot] = entry;
+    Hash_Group<T> *group = &hs->groups[slot / HASH_GROUP_SIZE];
+    group->ctrl[slot % HASH_GROUP_SIZE] = hash_ctrl_tag(hash);
+    group->entries[slot % HASH_GROUP_SIZE] = entry;
     ++hs->count;
     if(4*hs->count > 3*hs->set_size)
     {
@@ -234,15 +512,59 @@ void set_insert_into_slot(Hash_Set<T,K,GK,H,Eq> *hs, u64 slot, u64 hash, T entry
     }
 }
 
+// Note: the definition an atom was bound to before a scope bound it to something else
+struct Binding_Undo
+{
+    Atom atom;
+    Expr_AST *previous;
+};
+
+// Note: a reference from a top-level declaration to another one. decl_index is the position of
+// the declaration it is in, in the array given to create_scope_metadata
+struct Decl_Reference
+{
+    u32 decl_index;
+    Atom atom;
+    // Note: what a function body refers to can't change the type of the declaration
+    bool from_body;
+};
+
+struct Forward_Reference
+{
+    Ident_AST *ident;
+    u32 decl_index;
+    bool from_body;
+};
+
 struct Scoping_Context
 {
     Atom_Table *atom_table;
+    // Note: the scopes and their tables live in ast_pool
     Pool_Allocator *ast_pool;
+    // Note: indexed by atom id, the innermost definition of each name that is visible at the
+    // current point of the walk, so references are bound without looking them up in the scopes
+    Dynamic_Array<Expr_AST*> bindings;
+    // Note: a scope remembers the count when it is entered, and undoes everything above it when left
+    Dynamic_Array<Binding_Undo> undo_log;
+    // Note: the references that were not bound when they were visited
+    Dynamic_Array<Forward_Reference> forward_references;
+    // Note: if set, the references between top-level declarations are added to it
+    Dynamic_Array<Decl_Reference> *decl_references;
+    Hashed_Scope *file_scope;
+    // Note: the top-level declaration being walked, and whether the walk is in a function body
+    u32 decl_index;
+    bool in_function_body;
     bool success;
 };
 
+void init_scoping_context(Scoping_Context *ctx, Atom_Table *atom_table, Pool_Allocator *ast_pool);
+
 struct Decl_AST;
-bool create_scope_metadata(Scoping_Context *ctx, Array<Decl_AST*> decls);
+// Note: also binds every identifier reference to its definition (see ident_get_expr),
+// or reports it as undeclared
+// The declarations that are already_scoped keep the scopes and bindings of an earlier call, and
+// are only declared in the new file scope
+bool create_scope_metadata(Scoping_Context *ctx, Array<Decl_AST*> decls, Array<bool> already_scoped = {});
 
 
 #endif // SCOPE_H
\ No newline at end of file
@@ -0,0 +1,173 @@
+
+struct Tracking_Header
+{
+    u64 size;
+    Alloc_Tag tag;
+    u32 pad;
+};
+
+void init_tracking_allocator(Tracking_Allocator *ta, Allocator parent)
+{
+    zero_struct(ta);
+    ta->parent = parent;
+    pthread_mutex_init(&ta->mutex, nullptr);
+    for(u64 i = 0; i < (u64)Alloc_Tag::count; ++i)
+    {
+        ta->tags[i].tracker = ta;
+        ta->tags[i].tag = (Alloc_Tag)i;
+    }
+}
+
+Allocator tracking_allocator(Tracking_Allocator *ta, Alloc_Tag tag)
+{
+    Allocator result;
+    result.function = tracking_alloc_func;
+    result.data = &ta->tags[(u64)tag];
+    return result;
+}
+
+internal
+void stats_add(Allocation_Stats *stats, u64 size)
+{
+    stats->live_bytes += size;
+    stats->allocated_bytes += size;
+    stats->peak_bytes = max(stats->peak_bytes, stats->live_bytes);
+}
+
+internal
+void stats_remove(Allocation_Stats *stats, u64 size)
+{
+    // Note: memory allocated in an earlier phase may be freed in this one, but a phase starts with
+    // the live bytes of the total, so they still cover it
+    assert(stats->live_bytes >= size);
+    stats->live_bytes -= size;
+}
+
+internal
+void track_alloc(Tracking_Allocator *ta, Alloc_Tag tag, u64 size)
+{
+    Tracking_Tag *t = &ta->tags[(u64)tag];
+    stats_add(&ta->stats, size);
+    stats_add(&ta->phase_stats, size);
+    stats_add(&t->stats, size);
+    stats_add(&t->phase_stats, size);
+}
+
+internal
+void track_dealloc(Tracking_Allocator *ta, Alloc_Tag tag, u64 size)
+{
+    Tracking_Tag *t = &ta->tags[(u64)tag];
+    stats_remove(&ta->stats, size);
+    stats_remove(&ta->phase_stats, size);
+    stats_remove(&t->stats, size);
+    stats_remove(&t->phase_stats, size);
+}
+
+void *tracking_alloc_func(void *data, Allocator_Mode mode, void *old_ptr, u64 old_size, u64 new_size)
+{
+    Tracking_Tag *tag = static_cast<Tracking_Tag*>(data);
+    Tracking_Allocator *ta = tag->tracker;
+    Allocator parent = ta->parent;
+    
+    if(mode == Allocator_Mode::alloc)
+    {
+        Tracking_Header *header = (Tracking_Header*)mem_alloc_(sizeof(Tracking_Header) + new_size, parent);
+        if(!header)
+        {
+            return nullptr;
+        }
+        header->size = new_size;
+        header->tag = tag->tag;
+        
+        pthread_mutex_lock(&ta->mutex);
+        track_alloc(ta, tag->tag, new_size);
+        ++ta->stats.alloc_count;
+        ++ta->phase_stats.alloc_count;
+        ++tag->stats.alloc_count;
+        ++tag->phase_stats.alloc_count;
+        pthread_mutex_unlock(&ta->mutex);
+        
+        return (void*)(header + 1);
+    }
+    else if(mode == Allocator_Mode::resize)
+    {
+        Tracking_Header *old_header = ((Tracking_Header*)old_ptr) - 1;
+        assert(old_header->size == old_size);
+        Alloc_Tag old_tag = old_header->tag;
+        
+        Tracking_Header *header = (Tracking_Header*)mem_resize_(old_header, sizeof(Tracking_Header) + old_size, sizeof(Tracking_Header) + new_size, parent);
+        if(!header)
+        {
+            return nullptr;
+        }
+        header->size = new_size;
+        header->tag = tag->tag;
+        
+        pthread_mutex_lock(&ta->mutex);
+        track_dealloc(ta, old_tag, old_size);
+        track_alloc(ta, tag->tag, new_size);
+        ++ta->stats.resize_count;
+        ++ta->phase_stats.resize_count;
+        ++tag->stats.resize_count;
+        ++tag->phase_stats.resize_count;
+        pthread_mutex_unlock(&ta->mutex);
+        
+        return (void*)(header + 1);
+    }
+    else if(mode == Allocator_Mode::dealloc)
+    {
+        if(old_ptr)
+        {
+            Tracking_Header *header = ((Tracking_Header*)old_ptr) - 1;
+            assert(header->size == old_size);
+            Tracking_Tag *old_tag = &ta->tags[(u64)header->tag];
+            
+            pthread_mutex_lock(&ta->mutex);
+            track_dealloc(ta, header->tag, header->size);
+            ++ta->stats.dealloc_count;
+            ++ta->phase_stats.dealloc_count;
+            ++old_tag->stats.dealloc_count;
+            ++old_tag->phase_stats.dealloc_count;
+            pthread_mutex_unlock(&ta->mutex);
+            
+            mem_dealloc_(header, sizeof(Tracking_Header) + header->size, parent);
+        }
+        return nullptr;
+    }
+    
+    assert(false);
+    return nullptr;
+}
+
+internal
+void print_stats_row(const byte *name, Allocation_Stats *phase, Allocation_Stats *total)
+{
+    print_err("  %-10s %12lu %12lu %12lu %8lu %8lu %8lu %12lu\n", name, total->live_bytes, phase->peak_bytes, phase->allocated_bytes, phase->alloc_count, phase->resize_count, phase->dealloc_count, total->peak_bytes);
+}
+
+internal
+void begin_phase(Allocation_Stats *phase, Allocation_Stats *total)
+{
+    zero_struct(phase);
+    phase->live_bytes = total->live_bytes;
+    phase->peak_bytes = total->live_bytes;
+}
+
+void print_allocation_stats(Tracking_Allocator *ta, const byte *phase_name)
+{
+    pthread_mutex_lock(&ta->mutex);
+    print_err("Memory after %s:\n", phase_name);
+    print_err("  %-10s %12s %12s %12s %8s %8s %8s %12s\n", "tag", "live", "phase peak", "phase bytes", "allocs", "resizes", "deallocs", "total peak");
+    for(u64 i = 0; i < (u64)Alloc_Tag::count; ++i)
+    {
+        Tracking_Tag *t = &ta->tags[i];
+        if(t->stats.alloc_count)
+        {
+            print_stats_row(alloc_tag_names[i], &t->phase_stats, &t->stats);
+        }
+        begin_phase(&t->phase_stats, &t->stats);
+    }
+    print_stats_row("all", &ta->phase_stats, &ta->stats);
+    begin_phase(&ta->phase_stats, &ta->stats);
+    pthread_mutex_unlock(&ta->mutex);
+}
@@ -0,0 +1,88 @@
+#ifndef TRACKING_ALLOCATOR_H
+#define TRACKING_ALLOCATOR_H
+
+#include "basic.h"
+#include <pthread.h>
+
+enum class Alloc_Tag : u32
+{
+    untagged,
+    source,
+    tokens,
+    parse,
+    scope,
+    typecheck,
+    
+    count,
+};
+
+const byte *alloc_tag_names[] = {
+    "untagged",
+    "source",
+    "tokens",
+    "parse",
+    "scope",
+    "typecheck",
+};
+
+struct Allocation_Stats
+{
+    u64 live_bytes;
+    u64 peak_bytes;
+    u64 allocated_bytes;
+    u64 alloc_count;
+    u64 resize_count;
+    u64 dealloc_count;
+};
+
+struct Tracking_Allocator;
+
+// Note: one of these per tag, so that Allocator::data identifies the call-site tag
+struct Tracking_Tag
+{
+    Tracking_Allocator *tracker;
+    Alloc_Tag tag;
+    Allocation_Stats stats;
+    Allocation_Stats phase_stats;
+};
+
+// Wraps another allocator, and records live/peak bytes and allocation counts per tag
+// Each allocation carries a small header with its size and tag, so memory can be
+// freed through a different tag than it was allocated with
+// Note: memory must be allocated and freed through the same Tracking_Allocator. The typechecking
+// workers allocate through it too, so the stats are only updated with the mutex held
+struct Tracking_Allocator
+{
+    Allocator parent;
+    pthread_mutex_t mutex;
+    Allocation_Stats stats;
+    Allocation_Stats phase_stats;
+    Tracking_Tag tags[(u64)Alloc_Tag::count];
+};
+
+void init_tracking_allocator(Tracking_Allocator *ta, Allocator parent);
+Allocator tracking_allocator(Tracking_Allocator *ta, Alloc_Tag tag = Alloc_Tag::untagged);
+
+void *tracking_alloc_func(void *data, Allocator_Mode mode, void *old_ptr, u64 old_size, u64 new_size);
+
+// Prints the stats since the last call (or since init), then starts a new phase
+void print_allocation_stats(Tracking_Allocator *ta, const byte *phase_name);
+
+// Note: build with -DTRACK_ALLOCATIONS to have the driver report memory use per phase
+#ifdef TRACK_ALLOCATIONS
+Tracking_Allocator allocation_tracker;
+
+#define init_allocation_tracking() \
+(init_tracking_allocator(&allocation_tracker, default_allocator), \
+ default_allocator = tracking_allocator(&allocation_tracker))
+#define begin_tracked_phase(tag) \
+(default_allocator = tracking_allocator(&allocation_tracker, (tag)))
+#define end_tracked_phase(phase_name) \
+print_allocation_stats(&allocation_tracker, (phase_name))
+#else
+#define init_allocation_tracking()
+#define begin_tracked_phase(tag)
+#define end_tracked_phase(phase_name)
+#endif
+
+#endif // TRACKING_ALLOCATOR_H
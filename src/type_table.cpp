@@ -0,0 +1,335 @@
+
+internal
+Primitive_AST *builtin_primitive_types[] = {
+    &u8_t_ast,
+    &u16_t_ast,
+    &u32_t_ast,
+    &u64_t_ast,
+    &s8_t_ast,
+    &s16_t_ast,
+    &s32_t_ast,
+    &s64_t_ast,
+    &bool8_t_ast,
+    &bool16_t_ast,
+    &bool32_t_ast,
+    &bool64_t_ast,
+    &f32_t_ast,
+    &f64_t_ast,
+    &void_t_ast,
+    &type_t_ast,
+    &intlike_t_ast,
+    &floatlike_t_ast,
+    &numberlike_t_ast,
+    &boollike_t_ast,
+};
+
+internal inline
+u64 mix_type_hash(u64 hash, u64 value)
+{
+    hash = (hash ^ value) * 0x9e3779b97f4a7c15UL;
+    return hash ^ (hash >> 29);
+}
+
+// Note: the parts of a canonical type are canonical, so they can be hashed by address
+u64 hash_canonical_type(Expr_AST *type)
+{
+    u64 hash = mix_type_hash(0, (u64)type->type);
+    if(type->type == AST_Type::unary_ast)
+    {
+        hash = mix_type_hash(hash, (u64)static_cast<Unary_Operator_AST*>(type)->operand);
+    }
+    else
+    {
+        assert(type->type == AST_Type::function_type_ast);
+        Function_Type_AST *function_type = static_cast<Function_Type_AST*>(type);
+        hash = mix_type_hash(hash, function_type->parameter_types.count);
+        for(u64 i = 0; i < function_type->parameter_types.count; ++i)
+        {
+            hash = mix_type_hash(hash, (u64)function_type->parameter_types[i]);
+        }
+        hash = mix_type_hash(hash, function_type->return_types.count);
+        for(u64 i = 0; i < function_type->return_types.count; ++i)
+        {
+            hash = mix_type_hash(hash, (u64)function_type->return_types[i]);
+        }
+    }
+    // Note: the set takes its tag from the low bits
+    return hash ^ (hash >> 32);
+}
+
+internal
+bool canonical_parts_equal(Array<Expr_AST*> parts1, Array<Expr_AST*> parts2)
+{
+    if(parts1.count != parts2.count)
+    {
+        return false;
+    }
+    for(u64 i = 0; i < parts1.count; ++i)
+    {
+        if(parts1[i] != parts2[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool canonical_types_equal(Expr_AST *t1, Expr_AST *t2)
+{
+    if(t1->type != t2->type)
+    {
+        return false;
+    }
+    if(t1->type == AST_Type::unary_ast)
+    {
+        return static_cast<Unary_Operator_AST*>(t1)->operand == static_cast<Unary_Operator_AST*>(t2)->operand;
+    }
+    Function_Type_AST *f1 = static_cast<Function_Type_AST*>(t1);
+    Function_Type_AST *f2 = static_cast<Function_Type_AST*>(t2);
+    return canonical_parts_equal(f1->parameter_types, f2->parameter_types) &&
+        canonical_parts_equal(f1->return_types, f2->return_types);
+}
+
+void init_type_table(Type_Table *tt, u64 serial_count)
+{
+    pthread_mutex_init(&tt->lock, nullptr);
+    init_hash_set(&tt->type_set, 64);
+    tt->serial_count = serial_count;
+    tt->entries = nullptr;
+}
+
+void free_type_table(Type_Table *tt)
+{
+    pthread_mutex_destroy(&tt->lock);
+    free_hash_set(&tt->type_set);
+    if(tt->entries)
+    {
+        mem_dealloc(tt->entries, tt->serial_count);
+        tt->entries = nullptr;
+    }
+    tt->serial_count = 0;
+}
+
+// Note: like reduce_type, but gives up instead of yielding or reporting an error
+internal
+Expr_AST *peek_reduced_type(Type_Table *tt, Expr_AST *type)
+{
+    while(type && type_resolved(type))
+    {
+        Expr_AST *reduced = cached_reduced_type(tt, type);
+        if(reduced)
+        {
+            return reduced;
+        }
+        switch(type->type)
+        {
+            case AST_Type::ident_ast: {
+                Ident_AST *ident_ast = static_cast<Ident_AST*>(type);
+                u64 ident_type = ident_get_type(ident_ast);
+                bool constant = (ident_ast->flags & EXPR_FLAG_CONSTANT);
+                if(ident_type != IDENT_REFERENCE && !(ident_type == IDENT_DECL && constant))
+                {
+                    return nullptr;
+                }
+                type = ident_get_expr(ident_ast);
+            } break;
+            case AST_Type::access_ast: {
+                type = static_cast<Access_AST*>(type)->expr;
+            } break;
+            case AST_Type::unary_ast:
+            case AST_Type::function_type_ast:
+            case AST_Type::struct_ast:
+            case AST_Type::enum_ast:
+            case AST_Type::primitive_ast: {
+                return type;
+            } break;
+            default: {
+                return nullptr;
+            } break;
+        }
+    }
+    return nullptr;
+}
+
+// Note: the side table is only made once it is needed, since many files have no aliases, and
+// compare few pointer or function types
+internal
+Type_Entry *get_type_entries(Type_Table *tt)
+{
+    Type_Entry *entries = __atomic_load_n(&tt->entries, __ATOMIC_ACQUIRE);
+    if(!entries)
+    {
+        pthread_mutex_lock(&tt->lock);
+        entries = tt->entries;
+        if(!entries)
+        {
+            entries = mem_alloc(Type_Entry, tt->serial_count);
+            zero_memory(entries, tt->serial_count);
+            __atomic_store_n(&tt->entries, entries, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&tt->lock);
+    }
+    return entries;
+}
+
+// Note: several threads may cache the same node, but they all store the same type
+void cache_reduced_type(Type_Table *tt, Expr_AST *type, Expr_AST *reduced)
+{
+    assert(type->type == AST_Type::ident_ast || type->type == AST_Type::access_ast);
+    if(type->s >= tt->serial_count)
+    {
+        return;
+    }
+    Type_Entry *entries = get_type_entries(tt);
+    __atomic_store_n(&entries[type->s].reduced, reduced, __ATOMIC_RELEASE);
+}
+
+internal
+Expr_AST *make_canonical_node(Expr_AST *node)
+{
+    node->flags = AST_FLAG_SYNTHETIC | TYPE_FLAG_CANONICAL;
+    node->s = __atomic_fetch_add(&next_serial, 1, __ATOMIC_RELAXED);
+    node->line_number = 0;
+    node->line_offset = 0;
+    node->resolved_type = &type_t_ast;
+    node->types.count = 1;
+    return node;
+}
+
+// Note: the parts are allocated first, so that they can be given back if the type is known
+internal
+bool canonical_parts(Type_Table *tt, Pool_Allocator *pool, Array<Expr_AST*> parts, Array<Expr_AST*> *out)
+{
+    out->count = parts.count;
+    out->data = pool_alloc(Expr_AST*, parts.count, pool);
+    for(u64 i = 0; i < parts.count; ++i)
+    {
+        // Note: an inferred parameter type is filled in by another job
+        Expr_AST *part = __atomic_load_n(&parts.data[i], __ATOMIC_ACQUIRE);
+        (*out)[i] = part ? canonical_type(tt, pool, part) : nullptr;
+        if(!(*out)[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Note: probe is a canonical type on the stack, or in pool, interned by copying it into pool if
+// it is new
+internal
+Expr_AST *intern_type(Type_Table *tt, Pool_Allocator *pool, Expr_AST *probe, u64 probe_size)
+{
+    u64 hash = hash_canonical_type(probe);
+    pthread_mutex_lock(&tt->lock);
+    defer {
+        pthread_mutex_unlock(&tt->lock);
+    };
+    
+    u64 slot = set_find_slot(&tt->type_set, probe, hash);
+    if(!set_slot_empty(&tt->type_set, slot))
+    {
+        return *set_slot_entry(&tt->type_set, slot);
+    }
+    Expr_AST *canonical = (Expr_AST*)pool_alloc_(pool, probe_size);
+    copy_memory((byte*)canonical, (byte*)probe, probe_size);
+    make_canonical_node(canonical);
+    set_insert_into_slot(&tt->type_set, slot, hash, canonical);
+    return canonical;
+}
+
+internal
+Expr_AST *find_canonical_type(Type_Table *tt, Pool_Allocator *pool, Expr_AST *type)
+{
+    switch(type->type)
+    {
+        case AST_Type::primitive_ast: {
+            u64 primitive = static_cast<Primitive_AST*>(type)->primitive;
+            for(u64 i = 0; i < static_array_size(builtin_primitive_types); ++i)
+            {
+                if(builtin_primitive_types[i]->primitive == primitive)
+                {
+                    return builtin_primitive_types[i];
+                }
+            }
+            return nullptr;
+        } break;
+        case AST_Type::struct_ast:
+        case AST_Type::enum_ast: {
+            return type;
+        } break;
+        case AST_Type::unary_ast: {
+            Unary_Operator_AST *unop_ast = static_cast<Unary_Operator_AST*>(type);
+            assert(unop_ast->op == Unary_Operator::ref);
+            Expr_AST *operand = canonical_type(tt, pool, unop_ast->operand);
+            if(!operand)
+            {
+                return nullptr;
+            }
+            Unary_Operator_AST probe;
+            zero_struct(&probe);
+            probe.type = AST_Type::unary_ast;
+            probe.op = Unary_Operator::ref;
+            probe.operand = operand;
+            return intern_type(tt, pool, &probe, sizeof(probe));
+        } break;
+        case AST_Type::function_type_ast: {
+            Function_Type_AST *function_type = static_cast<Function_Type_AST*>(type);
+            Function_Type_AST probe;
+            zero_struct(&probe);
+            probe.type = AST_Type::function_type_ast;
+            Expr_AST *canonical = nullptr;
+            if(canonical_parts(tt, pool, function_type->parameter_types, &probe.parameter_types) &&
+               canonical_parts(tt, pool, function_type->return_types, &probe.return_types))
+            {
+                canonical = intern_type(tt, pool, &probe, sizeof(probe));
+            }
+            if(!canonical || static_cast<Function_Type_AST*>(canonical)->parameter_types.data != probe.parameter_types.data)
+            {
+                // Note: only gives the memory back if nothing else was allocated since
+                pool_dealloc_(pool, probe.return_types.data, probe.return_types.count * sizeof(Expr_AST*));
+                pool_dealloc_(pool, probe.parameter_types.data, probe.parameter_types.count * sizeof(Expr_AST*));
+            }
+            return canonical;
+        } break;
+        default: {
+            assert(false);
+        } break;
+    }
+    return nullptr;
+}
+
+Expr_AST *canonical_type(Type_Table *tt, Pool_Allocator *pool, Expr_AST *type)
+{
+    if(type->flags & TYPE_FLAG_CANONICAL)
+    {
+        return type;
+    }
+    type = peek_reduced_type(tt, type);
+    if(!type || (type->flags & TYPE_FLAG_CANONICAL))
+    {
+        return type;
+    }
+    
+    // Note: primitives, structs and enums are quick to look up every time
+    if(type->type != AST_Type::unary_ast && type->type != AST_Type::function_type_ast)
+    {
+        return find_canonical_type(tt, pool, type);
+    }
+    
+    Type_Entry *entries = (type->s < tt->serial_count) ? get_type_entries(tt) : nullptr;
+    if(entries)
+    {
+        Expr_AST *canonical = __atomic_load_n(&entries[type->s].canonical, __ATOMIC_ACQUIRE);
+        if(canonical)
+        {
+            return canonical;
+        }
+    }
+    Expr_AST *canonical = find_canonical_type(tt, pool, type);
+    if(canonical && entries)
+    {
+        __atomic_store_n(&entries[type->s].canonical, canonical, __ATOMIC_RELEASE);
+    }
+    return canonical;
+}
@@ -0,0 +1,74 @@
+#ifndef TYPE_TABLE_H
+#define TYPE_TABLE_H
+
+#include "ast.h"
+#include "basic.h"
+#include "pool_allocator.h"
+#include "scope.h"
+#include <pthread.h>
+
+// Note: maps every type to a canonical node, so that two types are the same exactly when they
+// have the same canonical node
+// Primitives map to the built-in primitive nodes, and structs and enums are their own canonical
+// node, since they are nominal. Pointer and function types are interned: their canonical nodes
+// are synthetic, and made of canonical parts.
+// The type nodes in the source are not replaced, so they keep their locations for diagnostics.
+// Instead, the canonical node of each one is kept in a side table, indexed by serial.
+// The side table also remembers what each ident or access used as a type reduces to.
+
+inline
+Expr_AST *get_type_key(Expr_AST *&type) { return type; }
+u64 hash_canonical_type(Expr_AST *type);
+bool canonical_types_equal(Expr_AST *t1, Expr_AST *t2);
+
+struct Type_Entry
+{
+    // Note: only set for pointer and function types
+    Expr_AST *canonical;
+    // Note: null until the ident or access is reduced
+    Expr_AST *reduced;
+};
+
+struct Type_Table
+{
+    // Note: guards type_set, and making the side table. The entries of the side table are read
+    // and written without it
+    pthread_mutex_t lock;
+    Hash_Set<Expr_AST*,Expr_AST*,get_type_key,hash_canonical_type,canonical_types_equal> type_set;
+    // Note: only the nodes that existed when the table was made have an entry, the canonical
+    // nodes of later ones are looked up every time
+    Type_Entry *entries;
+    u64 serial_count;
+};
+
+// Note: serial_count is one past the last serial that gets an entry in the side table
+void init_type_table(Type_Table *tt, u64 serial_count);
+void free_type_table(Type_Table *tt);
+
+// Note: null while type, or a part of it, is not resolved yet, or if it is not a type at all
+// Never reports an error, so it can be tried before the checks that do. New canonical nodes are
+// allocated from pool.
+Expr_AST *canonical_type(Type_Table *tt, Pool_Allocator *pool, Expr_AST *type);
+
+// Note: null if the ident or access type has not been reduced yet, or if it is not an ident or
+// access. The flags of the node are not used to mark it, since other threads read them without
+// atomics
+inline
+Expr_AST *cached_reduced_type(Type_Table *tt, Expr_AST *type)
+{
+    if(type->type != AST_Type::ident_ast && type->type != AST_Type::access_ast)
+    {
+        return nullptr;
+    }
+    Type_Entry *entries = __atomic_load_n(&tt->entries, __ATOMIC_ACQUIRE);
+    if(!entries || type->s >= tt->serial_count)
+    {
+        return nullptr;
+    }
+    return __atomic_load_n(&entries[type->s].reduced, __ATOMIC_ACQUIRE);
+}
+// Note: remembers that the ident or access type reduces to reduced. Nodes without an entry in the
+// side table are reduced every time
+void cache_reduced_type(Type_Table *tt, Expr_AST *type, Expr_AST *reduced);
+
+#endif // TYPE_TABLE_H
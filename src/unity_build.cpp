@@ -1,21 +1,35 @@
 #include "ast.h"
 #include "basic.h"
+#include "bench.h"
 #include "check.h"
+#include "concurrent_atom_table.h"
+#include "incremental.h"
 #include "io.h"
+#include "job_queue.h"
 #include "lex.h"
 #include "main.h"
+#include "parallel_check.h"
 #include "parse.h"
 #include "pool_allocator.h"
 #include "scope.h"
 #include "stb/stb_sprintf.h"
+#include "tracking_allocator.h"
+#include "type_table.h"
 
 #include "ast.cpp"
 #include "basic.cpp"
+#include "bench.cpp"
 #include "check.cpp"
+#include "concurrent_atom_table.cpp"
+#include "incremental.cpp"
 #include "io.cpp"
+#include "job_queue.cpp"
 #include "lex.cpp"
 #include "main.cpp"
+#include "parallel_check.cpp"
 #include "parse.cpp"
 #include "pool_allocator.cpp"
 #include "scope.cpp"
 #include "stb/stb_sprintf.c"
+#include "tracking_allocator.cpp"
+#include "type_table.cpp"